@@ -1,14 +1,14 @@
 #pragma once
 
-#ifdef DEBUG
-#include "debug/debug.hh"
-#endif
-
 #include <cstdint>
 #include <iostream> // Only used for debugging
 #include <fstream>  // Only used for debugging
 #include <memory>
+#include <unordered_map>
+#include <vector>
 #include "memory.hh"
+#include "hooks.hh"
+#include "state.hh"
 
 struct cpu_bus;
 struct ppu_bus;
@@ -20,29 +20,51 @@ private:
     // A pointer to the CPU busline
     cpu_bus* m_bus;
 
+    // Receives debug and instrumentation hooks, nullptr when nothing is attached
+    Instrumentation* m_hooks;
+
+    // Only told about instructions as they start, see Hooks::Traced. nullptr when not tracing
+    Instrumentation* m_tracer;
+
     // CPU Registers - 8 bits
     uint8_t m_reg_a, m_reg_x, m_reg_y, m_reg_s;
     union {
-        // Processor status
+        // Processor status, only the bits that rarely change. Use get_p and set_p
+        //      for the whole register
         uint8_t m_reg_p;
         struct {
             // Individual bits of processor status
-            bool m_flag_c  : 1; // Carry bit
-            bool m_flag_z  : 1; // Zero
+            bool           : 1; // Carry bit, in m_flag_c
+            bool           : 1; // Zero, from m_zn
             bool m_flag_i  : 1; // Disable interrupts
             bool m_flag_d  : 1; // Decimal mode
             bool m_flag_b  : 1; // Break
             bool m_unused  : 1;
-            bool m_flag_v  : 1; // Overflow
-            bool m_flag_n  : 1; // Negative
+            bool           : 1; // Overflow, in m_flag_v
+            bool           : 1; // Negative, from m_zn
         };
     };
+
+    // Flags nearly every instruction writes are kept out of the packed register,
+    //      so setting them is a plain store rather than a read-modify-write
+    bool m_flag_c, m_flag_v;
+
+    // The result Z and N are derived from, only when something reads them. Z is
+    //      set when the low byte is zero and N when bit 7 or 15 is set. BIT sets
+    //      bit 15 to take N from the operand instead of the result
+    uint16_t m_zn;
+    bool flag_z() const { return (m_zn & 0x00FF) == 0; }
+    bool flag_n() const { return (m_zn & 0x8080) != 0; }
+
+    // The whole status register, for pushing, pulling and debugging
+    uint8_t get_p() const;
+    void set_p(uint8_t value);
     // Program counter is 16 bits
     uint16_t m_reg_pc;
 
     // Memory access to the cpu buslines
-    void WB(uint16_t addr, uint8_t value);
-    uint8_t RB(uint16_t addr);
+    template<typename Hooks> void WB(uint16_t addr, uint8_t value);
+    template<typename Hooks> uint8_t RB(uint16_t addr);
 
     /* Instructions and addressing modes ------------------ */
 
@@ -62,17 +84,97 @@ private:
     };
 
     // A template for instructions, see 2A03.cc for details
-    template<AddrModes, Operations> uint8_t ins();
+    template<typename Hooks, bool Decoded, AddrModes, Operations> uint8_t ins();
+
+    // Fetch the next operand byte of the executing instruction, from the bus or
+    //      when it was decoded ahead of time, from m_operands
+    template<typename Hooks, bool Decoded> uint8_t fetch(int n);
+
+    // Executes a single instruction, see hooks.hh for the hook policies. Trace is
+    //      Hooks::Traced when m_tracer is to see the instruction as well
+    template<typename Hooks, typename Trace = ::Hooks::Release> uint8_t step_impl();
+
+    // Registers as they are right now, for whatever is told about the instruction
+    CpuContext context(unsigned long long cycle) const;
+
+    // Service pending interrupts and return the cycles that took, then interpret the
+    //      instruction at the PC straight from the bus
+    template<typename Hooks> uint8_t interrupts();
+    template<typename Hooks> uint8_t interpret(uint8_t extra_cycles);
 
     /* Interrupts ----------------------------------------- */
 
-    // Flags for interrupt checking, will be checked and reset after
-    //      every instruction
+    // Flags for interrupt checking, will be checked after every instruction. NMI is
+    //      reset once serviced, IRQ is a level held by whatever raised it until it
+    //      lets go, and waits while interrupts are disabled
     bool m_irq_requested, m_nmi_requested;
 
     // A function to service either an nmi or irq based on the address
     //      passed indicating where to fetch the handler address
-    void do_interrupt(uint16_t addr);
+    template<typename Hooks> void do_interrupt(uint16_t addr);
+
+    /* Block cache ---------------------------------------- */
+
+    // An instruction decoded ahead of time, its handler takes the operands
+    //      from m_operands instead of fetching them through the bus again
+    struct MicroOp {
+        uint8_t (Ricoh2A03::*fn)(); // Handler, an instantiation of ins
+        uint8_t operands[2];        // Operand bytes following the opcode
+        uint8_t len;                // Base length of instruction in cycles
+        uint8_t offset;             // Offset of the opcode into its page
+        uint8_t opcode;
+    };
+
+    // A straight line run of instructions within a single 256 byte page, ending with
+    //      the first instruction that can jump. Blocks are keyed by the host address
+    //      of their first opcode, which tells apart PRG banks mapped to the same PC
+    struct Block {
+        const uint8_t* page;
+        std::vector<MicroOp> ops;
+    };
+    std::unordered_map<const uint8_t*, Block> m_blocks;
+
+    // The keys of every block decoded from a page, for dropping them all at once, and
+    //      whether the page is RAM rather than ROM
+    struct PageBlocks {
+        std::vector<const uint8_t*> blocks;
+        bool ram = false;
+    };
+    std::unordered_map<const uint8_t*, PageBlocks> m_page_blocks;
+
+    // Blocks recently jumped to indexed by PC, saves hashing on every taken branch
+    struct { const uint8_t* code; Block* block; } m_recent[0x400];
+
+    // The block being executed and the index of its next instruction
+    Block* m_block;
+    size_t m_cursor;
+
+    // Operands of the executing decoded instruction
+    uint8_t m_operands[2];
+
+    // The decoded instruction at the PC, nullptr when it can't be cached and has
+    //      to be interpreted from the bus
+    const MicroOp* next_op();
+    Block* decode_block(const uint8_t* page, uint8_t offset);
+
+public:
+
+    // Ways of getting from one instruction to the next, see run
+    enum Dispatch {
+        CALL,   // Indirect call through a table of handlers, the same as step
+        SWITCH, // A switch with every handler inlined into it
+        GOTO,   // Computed goto, GCC and Clang only. Falls back to SWITCH elsewhere
+    };
+    #if defined(__GNUC__)
+    static constexpr bool has_computed_goto = true;
+    #else
+    static constexpr bool has_computed_goto = false;
+    #endif
+
+private:
+
+    Dispatch m_dispatch;
+    template<Dispatch engine, typename Trace> unsigned run_impl(unsigned budget);
 
 public:
 
@@ -87,12 +189,44 @@ public:
     // Connect components
     void connect_bus(cpu_bus* cpu_bus_ptr);
 
+    // Attach a sink for debug and instrumentation hooks, nullptr detaches it
+    void attach(Instrumentation* sink);
+    Instrumentation* attached() const { return m_hooks; }
+
+    // Tell a sink about every instruction before it runs and nothing else, nullptr stops it.
+    //      Unlike attach this keeps the block cache and the dispatch engine, so it costs
+    //      about what the sink itself does
+    void trace(Instrumentation* tracer);
+    Instrumentation* tracer() const { return m_tracer; }
+
     // External signals
     void irq(); // Maskable interrupt signal
+    void irq_release(); // Maskable interrupt signal let go of
     void nmi(); // Non-maskable interrupt signal
     void rst(); // Reset signal
 
     // Drives the emulation
     uint8_t step();
 
+    // Execute instructions until at least budget cycles have passed, stepping the bus
+    //      after each one. Returns the number of instructions executed
+    unsigned run(unsigned budget);
+    void dispatch(Dispatch engine);
+
+    // Drop decoded blocks, either the ones decoded from a written page of RAM or
+    //      PRG RAM, or every block when whatever is mapped can no longer be trusted
+    void code_written(const uint8_t* page);
+    void flush_blocks();
+
+    // Drop the blocks decoded from RAM only, for loading a state of the same cartridge
+    //      where ROM is unchanged
+    void flush_ram_blocks();
+
+    // Whether any decoded blocks came from the page
+    bool caches_code(const uint8_t* page) const;
+
+    // Save states, see state.hh
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
+
 };
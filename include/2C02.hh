@@ -1,8 +1,11 @@
 #pragma once
+#include <climits>
 #include <memory>
 #include <array>
 #include "cart/cart.hh"
 #include "memory.hh"
+#include "hooks.hh"
+#include "state.hh"
 
 #ifdef DEBUG
 #include "debug/debug.hh"
@@ -16,12 +19,17 @@ struct ppu_bus;
 #define TV_W 256
 #define TV_H 240
 
+// Sprites on the last scanline can hang up to seven pixels off the end of a frame, so frame
+//      buffers have a little padding past the end
+const int frame_buf_size = TV_W * TV_H + 8;
+
 struct Ricoh2C02 {
 
 private:
 
-    // Pointer to frame buffer containing pixel data
-    std::shared_ptr<unsigned int[]> m_framebuf;
+    // Frame buffer being drawn into, the PPU's own one unless something else was handed to it
+    unsigned int* m_framebuf;
+    std::unique_ptr<unsigned int[]> m_own_framebuf;
     int m_buf_pos;    // Current position in frame buffer during a frame
 
     enum ppuState {
@@ -106,6 +114,9 @@ private:
     // Keep track of scanline and cycle
     int m_cycle, m_scanline;
 
+    // Total number of dots stepped since power on, three per CPU cycle once caught up
+    unsigned long long m_clock;
+
     // A representation of the sprites in object attribute memory
     typedef struct {
         uint8_t y_pos;
@@ -152,6 +163,22 @@ private:
     // A pointer to the CPU busline to trigger interrupts
     cpu_bus* m_cpu_bus;
 
+    // Receives debug and instrumentation hooks, nullptr when nothing is attached
+    Instrumentation* m_hooks;
+
+    // Steps a single dot, see hooks.hh for the hook policies
+    template<typename Hooks> void step_impl();
+
+    // Render all background pixels of the current visible scanline in one pass, fetching
+    //      each tile once. Leaves the PPU in the same state as stepping dots 1 through 256
+    void render_scanline();
+
+    // Cycle of every rendered scanline (and the pre render one) on which address line A12
+    //      rises for the first time since being low for long enough for mappers to see it,
+    //      -1 if it doesn't. Only the common layouts are modelled: 260 with sprites fetched
+    //      from $1000 and background from $0000, 324 the other way round
+    int scanline_clock_cycle() const;
+
 public:
 
     Ricoh2C02();
@@ -159,13 +186,27 @@ public:
     // Used to notify nes.cc to render a frame
     bool m_frameIncompete;
 
-    // Access the frame buffer for rendering
-    std::shared_ptr<unsigned int[]> get_buf();
+    // Render every pixel through fetch_bg_pixel, only used to check the output of the
+    //      scanline renderer against
+    bool m_per_dot = false;
+
+    // Access the frame buffer for rendering. Between frames it holds the last completed frame,
+    //      while emulating it holds whatever part of the next one has been drawn so far
+    const unsigned int* get_buf() const;
+
+    // Draw the following frames into buf instead, nullptr goes back to the PPU's own buffer.
+    //      Has to hold frame_buf_size pixels, and is best swapped between frames
+    void set_buf(unsigned int* buf);
 
     // Connect components
     void connect_bus(cpu_bus* cpu_bus_ptr);
     void connect_bus(ppu_bus* ppu_bus_ptr);
 
+    // Attach a sink for debug and instrumentation hooks, nullptr detaches it
+    void attach(Instrumentation* sink);
+    Instrumentation* attached() const { return m_hooks; }
+    bool instrumented() const { return m_hooks != nullptr; }
+
     // Memory access to the cpu buslines
     void WB(uint16_t addr, uint8_t value);
     uint8_t RB(uint16_t addr);
@@ -173,6 +214,27 @@ public:
     // Step the component one cycle
     void step();
 
+    // Step the component until its clock reaches the given dot. The cpu bus runs the PPU
+    //      lazily, only catching it up when something could observe the difference
+    void run_until(unsigned long long dot);
+
+    // Dot at which the PPU next does something visible to the rest of the system without
+    //      its registers being touched, either raising NMI on VBlank or completing a frame
+    unsigned long long next_event();
+
+    // Dot on which the mapper's scanline counter gets clocked for the n-th time from now, or
+    //      ULLONG_MAX if it won't be with rendering off. See scanline_clock_cycle
+    unsigned long long scanline_clock(int n);
+
+    // Scanline and cycle the PPU will be at (or was at) on the given dot. The PPU may lag
+    //      behind the CPU, this is where it would be if it were caught up
+    void position_at(unsigned long long dot, int& scanline, int& cycle) const;
+
+    // Save states, see state.hh. The frame buffer isn't saved, the next frame draws over
+    //      all of it anyway
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
+
     /* MMIO functions ------------------------------------- */
 
     uint8_t open_bus_r(); // Some registers are wr_only, and reading from them results in
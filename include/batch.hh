@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+/*
+    Batch runner. Runs every job in a job file on its own headless machine, spread over a work stealing
+    pool of threads, and reports how each one went along with the throughput of the whole batch.
+
+    Job files have a job per line: the rom path, the number of frames to run and optionally an input
+    file to play back on the first controller. Input files have a line per change to the buttons held:
+    the frame it happens on and the buttons as a hex mask (see Controller::set_buttons). In both, blank
+    lines and anything after a '#' are ignored.
+*/
+
+// Returns false if the job file couldn't be read, failing jobs are reported but don't count
+bool run_batch(const std::string& job_path, unsigned threads);
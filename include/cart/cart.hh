@@ -1,19 +1,26 @@
 #pragma once
 #include "cart/mapper.hh"
+#include "cart/rom.hh"
+#include "cart/romdb.hh"
 #include "mirrors.hh"
+#include "state.hh"
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
-class Mapper;
+struct cpu_bus;
 
 struct Cart {
 
 private:
 
-    // The NES cartridge header - iNES file format based
+    // The NES cartridge header, either iNES or NES 2.0. Decoded into m_info, kept as is
+    //      to check save states against
     //      https://www.nesdev.org/wiki/INES
+    //      https://www.nesdev.org/wiki/NES_2.0
     struct CartHeader {
         // Conatant - $43 $45 $53 $1A ("NES" followed by MS-DOS end-of-file)
         uint8_t constants[4]; 
@@ -27,52 +34,201 @@ private:
         
         // Mapper, mirroring, battery, trained
         uint8_t mapper_0;
-        // Mapper, VS/Playchoice
+        // Mapper, VS/Playchoice, NES 2.0 identifier
         uint8_t mapper_1;
         
-        // PRG_RAM size
+        // PRG_RAM size, NES 2.0: upper bits of the mapper and submapper
         uint8_t size_prg_ram;
-        // TV system
+        // TV system, NES 2.0: upper bits of the PRG and CHR ROM sizes
         uint8_t tv_system_0;
-        // TV system - again
+        // TV system - again, NES 2.0: PRG RAM and NVRAM sizes
         uint8_t tv_system_1;
-        // Usually filled with zeros, doesn't really matter
+        // Usually filled with zeros, NES 2.0: CHR RAM and NVRAM sizes, TV system, console
+        //      type, miscellaneous roms and default expansion device
         uint8_t padding[5];
     } m_cart_header;
 
-    // Vectors containing the contents of program and character roms as well as
-    //      program ram, each will be resized based on cartridge specs
-    std::vector<uint8_t> m_prg_rom;
-    std::vector<uint8_t> m_chr_rom;
+    // What the cartridge is made of, from the header or the rom database
+    CartInfo m_info;
+
+    // Program and character roms point straight into the rom image, shared with any other
+    //      cartridge of the same rom. Only the RAMs are the cartridge's own, character RAM
+    //      stands in for character rom on carts without any
+    std::shared_ptr<const RomImage> m_image;
+    const uint8_t* m_prg_rom = nullptr;
+    const uint8_t* m_chr_rom = nullptr;
+    size_t m_prg_rom_size = 0, m_chr_rom_size = 0;
+    std::vector<uint8_t> m_chr_ram;
     std::vector<uint8_t> m_prg_ram;
 
-    // A pointer to the cartridge's mapper and function to initialize said
-    //      mapper pointer given the respective mapper number
+    bool load_rom(std::shared_ptr<const RomImage> image);
+
+    // CRC32 of PRG ROM followed by CHR ROM, what save states check the rom against. Worked
+    //      out the first time a state needs it, on every load it would cost more than mapping
+    //      the rom does
+    mutable uint32_t m_rom_crc = 0;
+    mutable bool m_rom_crc_known = false;
+    uint32_t rom_crc() const;
+
+    // Read the header and CRC at the start of the CART section, true if they are this rom's
+    bool identified(StateReader& state) const;
+
+    // The cartridge's mapper and function to initialize said mapper given the
+    //      respective mapper number. Held as the concrete mapper type rather than
+    //      through a pointer to Mapper, so that the type is decided once here and
+    //      calls into the mapper (see with_mapper) are direct calls the compiler
+    //      can inline, not virtual ones
+    using MapperVariant = std::variant<std::monostate, Mapper_000, Mapper_001, Mapper_002, Mapper_004>;
     bool init_mapper(int mapper_number);
-    std::unique_ptr<Mapper> m_mapper;
+    MapperVariant m_mapper;
+
+    // Whether init_mapper can make the mapper, checked before anything of the cartridge
+    //      is replaced by a new rom
+    static bool supports_mapper(int mapper_number);
+
+    // Mappers with a mirroring register decide mirroring whatever the header says
+    bool m_mapper_mirroring = false;
+
+    // Call fn with the mapper as its concrete type. Returns whatever fn does, or a value
+    //      initialized one when no rom is loaded
+    template <typename Fn> auto with_mapper(Fn fn) {
+        using Result = decltype(fn(std::declval<Mapper_000&>()));
+        return std::visit([&](auto& mapper) -> Result {
+            if constexpr (std::is_same_v<std::decay_t<decltype(mapper)>, std::monostate>) return Result();
+            else return fn(mapper);
+        }, m_mapper);
+    }
+
+    // The CPU bus keeps pointers into cartridge memory, it is told when they go stale
+    cpu_bus* m_cpu_bus = nullptr;
+
+    // Decoded pattern data, for every row of every tile in CHR memory eight 2 bit color
+    //      indices followed by the same eight flipped horizontally. Tiles are decoded the
+    //      first time they are used and again after being written to
+    std::vector<uint8_t> m_chr_decoded;
+    std::vector<bool>    m_chr_valid;
+    void decode_tile(int tile);
+
+    // Offset into CHR memory of each 1 KB window of the pattern tables, -1 if the mapper
+    //      does not map memory there directly
+    int m_chr_map[8];
 
 public:
 
-    // Load a rom into the cartridge
+    // A cartridge with no rom loaded
+    Cart();
+
+    // Whether a rom is loaded, nothing can be run without one
+    bool loaded() const { return !std::holds_alternative<std::monostate>(m_mapper); }
+
+    // Connect the bus holding pointers into cartridge memory
+    void connect_bus(cpu_bus* cpu_bus_ptr);
+
+    // Load a rom into the cartridge, mapping the file (see rom.hh) or copying an iNES image
+    //      that is already in memory
     bool load_rom(const std::string& rom_path);
+    bool load_rom(const uint8_t* rom, size_t size);
 
     // Memory access by CPU
     void cpu_WB(uint16_t addr, uint8_t value);
     uint8_t cpu_RB(uint16_t addr);
 
+    // Direct pointers to 256 byte pages of cartridge memory for the CPU bus page tables,
+    //      nullptr when accesses to the page must go through cpu_RB / cpu_WB instead
+    const uint8_t* cpu_read_page(uint8_t page);
+    uint8_t* cpu_write_page(uint8_t page);
+
+    // Called by the mapper after a bank switch changes what cpu_read_page would return
+    void prg_banks_changed();
+
     // Memory access by PPU
     void ppu_WB(uint16_t addr, uint8_t value);
     uint8_t ppu_RB(uint16_t addr);
 
-    // To allow mapper to access the memory read from the ROM
-    uint8_t* get_PRG_ROM();
-    uint8_t* get_CHR_ROM();
+    // The eight decoded color indices of the tile row whose low bit plane is at addr, flipped
+    //      horizontally if requested. nullptr if the pattern data isn't directly mapped
+    const uint8_t* chr_row(uint16_t addr, bool flip);
+
+    // Called by the mapper after a bank switch changes what ppu_read_window would return
+    void chr_banks_changed();
+
+    // Scanline counting mappers, see Mapper::clock_scanline. They raise and acknowledge
+    //      IRQ on the CPU through irq
+    void clock_scanline();
+    int scanlines_until_irq();
+    void irq(bool asserted);
+
+    // To allow mapper to access the memory read from the ROM. CHR ROM is the CHR RAM on carts
+    //      without any, which get_CHR_RAM returns to write to, nullptr on carts with CHR ROM
+    const uint8_t* get_PRG_ROM();
+    const uint8_t* get_CHR_ROM();
+    uint8_t* get_CHR_RAM();
     uint8_t* get_PRG_RAM();
 
+    // What the cartridge is made of, see romdb.hh
+    const CartInfo& info() const { return m_info; }
+
+    // The mapper through its virtual interface, only for comparing against the direct calls.
+    //      nullptr when no rom is loaded
+    Mapper* virtual_mapper();
+
+    // The image the roms are in
+    const RomImage& rom_image() const { return *m_image; }
+
     // Return the mirroring mode being used
     ntMirrors::nameTableMirrorMode nt_mirror();
 
     // Reset signal to put cartridge in initial conditions
     void rst();
 
+    // Save states, see state.hh. PRG RAM, CHR RAM and the mapper's registers are saved,
+    //      loading checks the state was saved from the same header and rom contents
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
+
+    // Whether a state was saved from this rom, the check load does without loading anything
+    bool identifies(const std::vector<uint8_t>& state) const;
+
 };
+
+
+/* Mapper dispatch ---------------------------------------- */
+
+// Every access by the buses goes through these, inline so that the dispatch on the mapper
+//      type gets folded into the bus code
+
+inline void Cart::cpu_WB(uint16_t addr, uint8_t value) {
+    with_mapper([&](auto& mapper) { mapper.cpu_WB(addr, value); });
+}
+
+inline uint8_t Cart::cpu_RB(uint16_t addr) {
+    return with_mapper([&](auto& mapper) { return mapper.cpu_RB(addr); });
+}
+
+inline uint8_t Cart::ppu_RB(uint16_t addr) {
+    return with_mapper([&](auto& mapper) { return mapper.ppu_RB(addr); });
+}
+
+inline ntMirrors::nameTableMirrorMode Cart::nt_mirror() {
+
+    // The four screen bit being low (and the mapper not having a say) indicates that bit zero (which normally dictates
+    //      between horizontal or vertical being pyisically soldered so that its always
+    //      used) should be used to determine mirroring.
+    //      ...
+    // Mirroring mode ignores this bit and is mapper based other wise
+    if (!m_info.four_screen && !m_mapper_mirroring)
+        return m_info.vertical ?
+            ntMirrors::vertical  : 
+            ntMirrors::horizontal;
+
+    else return with_mapper([](auto& mapper) { return mapper.nt_mirror(); });
+
+}
+
+inline void Cart::clock_scanline() {
+    with_mapper([](auto& mapper) { mapper.clock_scanline(); });
+}
+
+inline int Cart::scanlines_until_irq() {
+    return with_mapper([](auto& mapper) { return mapper.scanlines_until_irq(); });
+}
@@ -1,7 +1,7 @@
 #pragma once
 #include <cstdint>
-#include "cart/cart.hh"
 #include "mirrors.hh"
+#include "state.hh"
 
 struct Cart;
 
@@ -10,22 +10,50 @@ class Mapper {
     /* Translates a given address, presented to it by the CPU or PPU, to a
        respective index into one of the cartridges memory block */
 
+    /* Cart holds its mapper as the concrete type (see Cart::with_mapper), so
+       the calls the buses make aren't virtual. Mappers must be final for that,
+       and be added to Cart's MapperVariant */
+
 public:
 
+    virtual ~Mapper() = default;
+
     // Mapper access by CPU
     virtual void cpu_WB(uint16_t addr, uint8_t value) = 0;
     virtual uint8_t cpu_RB(uint16_t addr) = 0;
 
+    // Pointers to the 256 byte page of cartridge memory currently mapped to a CPU page,
+    //      or nullptr if accesses need to go through cpu_RB / cpu_WB. Mappers must call
+    //      Cart::prg_banks_changed whenever a bank switch changes these
+    virtual const uint8_t* cpu_read_page(uint8_t page) { return nullptr; }
+    virtual uint8_t* cpu_write_page(uint8_t page) { return nullptr; }
+
     // Mapper access by PPU
     virtual void ppu_WB(uint16_t addr, uint8_t value) = 0;
     virtual uint8_t ppu_RB(uint16_t addr) = 0;
 
+    // Pointer to the 1 KB of CHR memory currently mapped at window * 0x400 on the PPU bus,
+    //      or nullptr if it can only be read through ppu_RB. Mappers must call
+    //      Cart::chr_banks_changed whenever a bank switch changes these
+    virtual const uint8_t* ppu_read_window(uint8_t window) { return nullptr; }
+
     // Return name table mirroring mode
     virtual ntMirrors::nameTableMirrorMode nt_mirror() = 0;
 
     // Reset mapper to initial conditions
     virtual void rst() = 0;
 
+    // Mappers counting scanlines are clocked once every rendered scanline, as the PPU raises
+    //      address line A12. scanlines_until_irq is how many more clocks until that raises
+    //      an IRQ (-1 for never), the PPU is left to lag behind the CPU until then
+    virtual void clock_scanline() {}
+    virtual int scanlines_until_irq() const { return -1; }
+
+    // Save and restore the mapper's registers for save states, see state.hh. Cartridge
+    //      memory is saved by Cart, mappers without registers needn't override these
+    virtual void save(StateWriter& state) const {}
+    virtual bool load(StateReader& state) { return state.ok(); }
+
 };
 
 /* -------------------------------------------------------- */
@@ -34,7 +62,7 @@ public:
 /*                                                          */
 /* -------------------------------------------------------- */
 
-class Mapper_000 : public Mapper {
+class Mapper_000 final : public Mapper {
 
 private:
 
@@ -52,10 +80,12 @@ public:
     // Mapper access by CPU
     void cpu_WB(uint16_t addr, uint8_t value) override;
     uint8_t cpu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* cpu_read_page(uint8_t page) override;
 
     // Mapper access by PPU
     void ppu_WB(uint16_t addr, uint8_t value) override;
     uint8_t ppu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* ppu_read_window(uint8_t window) override;
 
     // Return name table mirroring mode
     ntMirrors::nameTableMirrorMode nt_mirror() override;
@@ -71,11 +101,11 @@ public:
 /*                                                          */
 /* -------------------------------------------------------- */
 
-class Mapper_001 : public Mapper {
+class Mapper_001 final : public Mapper {
 
 private:
 
-    int m_size_prg_rom, m_size_chr_rom, m_size_prg_ram;
+    int m_size_prg_rom, m_size_chr, m_size_prg_ram;
     Cart* m_cart;
 
     // Internal regsiters
@@ -94,7 +124,20 @@ private:
             // Remaining bits are never written
         };
     } m_reg_ctrl;
-    uint8_t m_chr_bank0, m_chr_bank1, m_prg_bank0, m_prg_bank1;
+
+    // CHR bank registers, the low bit of bank 0 is ignored and bank 1 unused in 8 KB mode.
+    //      PRG bank register, the bank in the low four bits and bit 4 disabling PRG RAM.
+    //      Kept as written and only interpreted by update_banks, as the control register
+    //      changes what they mean
+    uint8_t m_chr_bank0, m_chr_bank1, m_prg_bank;
+
+    // Where the 16 KB halves of $8000 - $FFFF and the 4 KB halves of the pattern tables
+    //      currently point, worked out again whenever a register write completes so that
+    //      reads are a single lookup
+    const uint8_t* m_prg_base[2];
+    const uint8_t* m_chr_base[2];
+    bool m_prg_ram_enabled;
+    void update_banks();
 
     // Internal shift register
     struct {
@@ -109,24 +152,29 @@ private:
 
 public:
 
-    Mapper_001(Cart* cart_ptr, int sz_prg_rom, int sz_chr_rom, int sz_prg_ram) : 
+    // Sizes in bytes, CHR being the CHR RAM on carts without CHR ROM
+    Mapper_001(Cart* cart_ptr, int sz_prg_rom, int sz_chr, int sz_prg_ram) : 
         m_size_prg_rom(sz_prg_rom),
-        m_size_chr_rom(sz_chr_rom),
+        m_size_chr(sz_chr),
         m_size_prg_ram(sz_prg_ram),
         m_cart(cart_ptr) {
             // Initialize internal shift registers
             m_shift_register.data  = 0x00;
             m_shift_register.value = 0x20;
             m_shift_register.reset = 0x00;
+            rst();
         }
 
     // Mapper access by CPU
     void cpu_WB(uint16_t addr, uint8_t value) override;
     uint8_t cpu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* cpu_read_page(uint8_t page) override;
+    uint8_t* cpu_write_page(uint8_t page) /* -- */ override;
 
     // Mapper access by PPU
     void ppu_WB(uint16_t addr, uint8_t value) override;
     uint8_t ppu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* ppu_read_window(uint8_t window) override;
 
     // Return name table mirroring mode
     ntMirrors::nameTableMirrorMode nt_mirror() override;
@@ -134,6 +182,10 @@ public:
     // Reset mapper to initial conditions
     void rst() override;
 
+    // Save states
+    void save(StateWriter& state) const override;
+    bool load(StateReader& state) override;
+
 };
 
 /* -------------------------------------------------------- */
@@ -142,7 +194,7 @@ public:
 /*                                                          */
 /* -------------------------------------------------------- */
 
-class Mapper_002 : public Mapper {
+class Mapper_002 final : public Mapper {
 
 private:
 
@@ -175,10 +227,12 @@ public:
     // Mapper access by CPU
     void cpu_WB(uint16_t addr, uint8_t value) override;
     uint8_t cpu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* cpu_read_page(uint8_t page) override;
 
     // Mapper access by PPU
     void ppu_WB(uint16_t addr, uint8_t value) override;
     uint8_t ppu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* ppu_read_window(uint8_t window) override;
 
     // Return name table mirroring mode
     ntMirrors::nameTableMirrorMode nt_mirror() override;
@@ -186,5 +240,77 @@ public:
     // Reset mapper to initial conditions
     void rst() override;
 
+    // Save states
+    void save(StateWriter& state) const override;
+    bool load(StateReader& state) override;
+
 };
 
+/* -------------------------------------------------------- */
+/*                                                          */
+/*                   Mapper 004 (MMC3)                      */
+/*                                                          */
+/* -------------------------------------------------------- */
+
+class Mapper_004 final : public Mapper {
+
+private:
+
+    int m_size_prg_rom, m_size_chr;
+    bool m_header_vertical;
+    Cart* m_cart;
+
+    // Bank select ($8000), which of the bank registers $8001 writes to in the low three
+    //      bits, bit 6 swaps the PRG banks at $8000 and $C000, bit 7 the CHR halves
+    uint8_t m_bank_select;
+    uint8_t m_banks[8];
+
+    // Mirroring ($A000)
+    bool m_vertical;
+
+    // Scanline counter, reloaded from the latch ($C000) when it's at zero or asked to
+    //      be ($C001). Counting down to zero raises IRQ while enabled ($E001), disabling
+    //      it ($E000) also acknowledges it
+    uint8_t m_irq_latch, m_irq_counter;
+    bool m_irq_reload, m_irq_enabled;
+
+    // Offsets into PRG ROM of the four 8 KB windows from $8000 and into CHR memory of the
+    //      eight 1 KB windows of the pattern tables, worked out again on every bank switch
+    int m_prg_offsets[4], m_chr_offsets[8];
+    void update_banks();
+
+public:
+
+    // Sizes in bytes, CHR being the CHR RAM on carts without CHR ROM
+    Mapper_004(Cart* cart_ptr, int sz_prg_rom, int sz_chr, bool vertical) :
+        m_size_prg_rom(sz_prg_rom),
+        m_size_chr(sz_chr),
+        m_header_vertical(vertical),
+        m_cart(cart_ptr) { rst(); }
+
+    // Mapper access by CPU
+    void cpu_WB(uint16_t addr, uint8_t value) override;
+    uint8_t cpu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* cpu_read_page(uint8_t page) override;
+    uint8_t* cpu_write_page(uint8_t page) /* -- */ override;
+
+    // Mapper access by PPU
+    void ppu_WB(uint16_t addr, uint8_t value) override;
+    uint8_t ppu_RB(uint16_t addr) /* ----- */ override;
+    const uint8_t* ppu_read_window(uint8_t window) override;
+
+    // Return name table mirroring mode
+    ntMirrors::nameTableMirrorMode nt_mirror() override;
+
+    // Reset mapper to initial conditions
+    void rst() override;
+
+    // Scanline counter
+    void clock_scanline() override;
+    int scanlines_until_irq() const override;
+
+    // Save states
+    void save(StateWriter& state) const override;
+    bool load(StateReader& state) override;
+
+};
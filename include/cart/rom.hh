@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+    A rom file's contents, never written to once loaded. Files are memory mapped read only rather than
+    read, so loading costs next to nothing however big the rom is, pages are only read in once the
+    emulation touches them, and every process running the same rom shares the same physical memory for
+    it. Within a process a file is only mapped once, everything opening it while it's still open gets
+    the same image.
+
+    A mapped file must not be changed in place while it's open, the emulation would see the changes
+    (or crash if the file got shorter). Replacing the file is fine.
+*/
+
+class RomImage {
+
+public:
+
+    // Map a file, nullptr if it can't be opened. Falls back to reading the file where it
+    //      can't be mapped
+    static std::shared_ptr<const RomImage> open(const std::string& path);
+
+    // An image of its own holding a copy of the data, zero padded to at least size bytes
+    static std::shared_ptr<const RomImage> copy(const uint8_t* data, size_t size, size_t padded = 0);
+
+    ~RomImage();
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // Whether the data is mapped from the file, and so shared with anything else mapping it
+    bool mapped() const { return m_mapped; }
+
+private:
+
+    RomImage();
+
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_mapped;
+
+    // Holds the data of images that aren't mapped
+    std::vector<uint8_t> m_copy;
+
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+    What a cartridge is made of. Read from the rom's header, either iNES or NES 2.0, and replaced by
+    the rom database's entry for the rom when there is one, since plenty of roms floating around have
+    headers that are wrong or leave things out.
+
+    The database is a text file, one rom per line keyed by the CRC32 of everything in the file after
+    the header and trainer, which is the PRG ROM followed by the CHR ROM. It is read into a hash table
+    once at startup, after that looking a rom up is a single probe. testing/romdb.py builds one from
+    the NES 2.0 XML database, see romdb.txt for the format.
+*/
+
+struct CartInfo {
+
+    // TV system the game was made for, the emulator only runs NTSC timing
+    enum Region : uint8_t { ntsc, pal, multi, dendy };
+
+    int mapper = 0, submapper = 0;
+
+    // Mirroring soldered on the board, bit 0 of the iNES flags (1: vertical, 0: horizontal).
+    //      Four screen boards leave mirroring up to the mapper
+    bool vertical = false, four_screen = false;
+    bool battery = false, trainer = false;
+
+    // Sizes in bytes
+    size_t prg_rom = 0, chr_rom = 0;
+    size_t prg_ram = 0, prg_nvram = 0;
+    size_t chr_ram = 0, chr_nvram = 0;
+
+    Region region = ntsc;
+
+    // Whether the header was NES 2.0 rather than iNES
+    bool nes2 = false;
+
+    // Decode a 16 byte header, false if it isn't one
+    bool parse(const uint8_t* header);
+
+};
+
+namespace RomDb {
+
+    // CRC32 (the zip / PNG one) of size bytes, continuing on from crc
+    uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+    // Read a database file into the index, replacing whatever was there. Not thread safe,
+    //      load it before starting up any machines. False if the file can't be read
+    bool load(const std::string& path);
+
+    // The database's entry for the rom with the given CRC32, false if it has none
+    bool find(uint32_t crc, CartInfo& info);
+
+    // Number of roms in the database
+    size_t size();
+
+}
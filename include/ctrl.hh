@@ -1,9 +1,17 @@
 #pragma once
 
 #include <cstdint>
+#include "state.hh"
 
 /* Original NES control pad */
 
+// A change to the buttons held down, taking effect from the start of the given frame. Used to
+//      play back recorded input, see Controller::set_buttons for the button bits
+struct InputEvent {
+    unsigned long long frame;
+    uint8_t buttons;
+};
+
 struct Controller {
 
 private:
@@ -15,8 +23,14 @@ public:
 
     Controller();
 
-    void update(const uint8_t *keystate);
+    // Hold down buttons without a keyboard. Bit n is the n-th button the game reads out:
+    //      A, B, Select, Start, Up, Down, Left and Right
+    void set_buttons(uint8_t buttons);
     uint8_t r_joypad() /* --- */;
     void w_joypad(uint8_t value);
 
+    // Save states, see state.hh
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
+
 };
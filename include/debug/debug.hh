@@ -3,6 +3,7 @@
 #include <curses.h>      // Yeaaaah this will be a terminal based debugger
 #include <unordered_map> // For R,W,E breakpoints
 #include <cstdint>
+#include "hooks.hh"
 
 /* 
     I am in no way designing this debugger to be user friendly or robust. I am doing it for my own convenience
@@ -13,40 +14,11 @@
     It exists SOLEY for convenience
 */
 
-enum BreakpointType {
-    rd, wr, ex
-};
 struct Breakpoint {
     bool rd, wr, ex;
 };
 
-struct CpuContext {
-    // I may add more to this, ... unsure, it all
-    //      depends on what I want to observe
-    uint8_t  reg_a, reg_x, reg_y, reg_s;
-    union {
-        uint8_t reg_p;
-        struct {
-            bool flag_c : 1;
-            bool flag_z : 1;
-            bool flag_i : 1;
-            bool flag_d : 1;
-            bool flag_b : 1;
-            bool flag_u : 1;
-            bool flag_v : 1;
-            bool flag_n : 1;
-        };
-    };
-    uint16_t reg_pc;
-};
-
-struct PpuContext {
-    // This will almost certainly expand as PPU
-    //      mmio is implemented
-    int cycle, scanline;
-};
-
-class Debugger {
+class Debugger : public Instrumentation {
 
 public:
 
@@ -59,9 +31,11 @@ public:
     void do_break();
     void poll();
 
-    // For updating component information
-    void set_cpu_context(CpuContext& ctx);
-    void set_ppu_context(PpuContext& ctx);
+    // For updating component information, the debugger is attached to the CPU and PPU as
+    //      their instrumentation sink
+    void cpu_access(uint16_t addr, BreakpointType t) override;
+    void cpu_step(const CpuContext& ctx) override;
+    void ppu_step(const PpuContext& ctx) override;
     
     // Flags to invoke bus dumps
     bool m_dump_ppu_bus = false;
@@ -3,15 +3,28 @@
 #include <cstdint>
 #include <utility>
 #include <string>
-#include <map>
+#include <vector>
 
 struct GameGenie
 {
 
 private:
 
-    std::map<std::uint16_t, std::pair<std::uint8_t, std::uint8_t>> code_meta_8_chars;
-    std::map<std::uint16_t, std::uint8_t> code_meta_6_chars;
+    /* Every active code compiled into one patch per address, kept sorted by
+     * address. A 6-character code and an 8-character code may share an
+     * address, in which case the 6-character code wins. */
+    struct Patch {
+        std::uint16_t addr;
+        bool has_replace, has_compare;
+        std::uint8_t replace;        /* 6-character code, always substituted */
+        std::uint8_t data, compare;  /* 8-character code, substituted on match */
+    };
+    std::vector<Patch> patches;
+
+    /* One bit per 256 byte page of $8000 - $FFFF with at least one patch */
+    std::uint8_t patched_pages[0x80 / 8];
+
+    Patch &patch_at(std::uint16_t addr);
 
     std::pair<std::uint64_t, std::pair<std::uint8_t, std::uint8_t>>
         decode_8_char_code(const std::string &);
@@ -24,5 +37,16 @@ public:
     void add_code(const std::string &code);
     GameGenie();
 
+    /* True when some code patches an address within the given 256 byte page,
+     * reads from other pages never need to go through RB */
+    bool patches_page(std::uint8_t page) const
+    {
+        return page >= 0x80 &&
+            (patched_pages[(page - 0x80) >> 3] >> (page & 7)) & 1;
+    }
+
+    /* Number of distinct addresses patched */
+    std::size_t size() const { return patches.size(); }
+
 };
 
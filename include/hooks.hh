@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+
+/*
+    Debugging and instrumentation hooks for the CPU and PPU. Hot paths in both components are member
+    templates taking one of the policies at the bottom of this file. Release compiles every hook away,
+    Instrumented forwards them to whatever Instrumentation is attached. Both are always compiled in, the
+    components pick one at runtime depending on whether a sink is attached, so tracing can be switched
+    on in a running emulator without a rebuild.
+*/
+
+enum BreakpointType {
+    rd, wr, ex
+};
+
+struct CpuContext {
+    // I may add more to this, ... unsure, it all
+    //      depends on what I want to observe
+    uint8_t  reg_a, reg_x, reg_y, reg_s;
+    union {
+        uint8_t reg_p;
+        struct {
+            bool flag_c : 1;
+            bool flag_z : 1;
+            bool flag_i : 1;
+            bool flag_d : 1;
+            bool flag_b : 1;
+            bool flag_u : 1;
+            bool flag_v : 1;
+            bool flag_n : 1;
+        };
+    };
+    uint16_t reg_pc;
+    // CPU cycles since power on, including any interrupt serviced beforehand
+    unsigned long long cycle;
+};
+
+struct PpuContext {
+    // This will almost certainly expand as PPU
+    //      mmio is implemented
+    int cycle, scanline;
+};
+
+// Receives events from instrumented components, override whatever is of interest
+class Instrumentation {
+
+public:
+
+    virtual ~Instrumentation() = default;
+
+    // A CPU bus access, or an instruction about to be executed at addr
+    virtual void cpu_access(uint16_t addr, BreakpointType t) {}
+
+    // Right before every CPU instruction is executed, with the PC pointing at its opcode
+    virtual void cpu_instruction(const CpuContext& ctx) {}
+
+    // After every CPU instruction and every PPU dot
+    virtual void cpu_step(const CpuContext& ctx) {}
+    virtual void ppu_step(const PpuContext& ctx) {}
+
+};
+
+namespace Hooks {
+
+    // Nothing attached, every hook is an empty inline function
+    struct Release {
+        static constexpr bool enabled = false;
+        static void cpu_access(Instrumentation*, uint16_t, BreakpointType) {}
+        static void cpu_instruction(Instrumentation*, const CpuContext&) {}
+        static void cpu_step(Instrumentation*, const CpuContext&) {}
+        static void ppu_step(Instrumentation*, const PpuContext&) {}
+    };
+
+    // Forward every hook to the attached sink
+    struct Instrumented {
+        static constexpr bool enabled = true;
+        static void cpu_access(Instrumentation* sink, uint16_t addr, BreakpointType t) { sink->cpu_access(addr, t); }
+        static void cpu_instruction(Instrumentation* sink, const CpuContext& ctx) { sink->cpu_instruction(ctx); }
+        static void cpu_step(Instrumentation* sink, const CpuContext& ctx) { sink->cpu_step(ctx); }
+        static void ppu_step(Instrumentation* sink, const PpuContext& ctx) { sink->ppu_step(ctx); }
+    };
+
+    // Only instructions as they start, for tracing. Everything else runs as it does in release,
+    //      the block cache and the dispatch engines included
+    struct Traced : Release {
+        static void cpu_instruction(Instrumentation* sink, const CpuContext& ctx) { sink->cpu_instruction(ctx); }
+    };
+
+}
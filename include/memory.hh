@@ -1,11 +1,12 @@
 #pragma once
-#include <unordered_map>
 #include <memory>
 #include "2A03.hh"
 #include "2C02.hh"
 #include "ctrl.hh"
 #include "cart/cart.hh"
 #include "gamegenie.hh"
+#include "mirrors.hh"
+#include "state.hh"
 
 struct Ricoh2A03;
 struct Ricoh2C02;
@@ -26,9 +27,10 @@ private:
     // A pointer to the cartridge as the CPU will need to access PRGROM
     Cart* m_cart;
 
-    // Hash maps to map memory access functions for IO registers to virtual addresses
-    std::unordered_map<uint16_t, void(*)(cpu_bus& t, uint8_t value)> m_io_writes;
-    std::unordered_map<uint16_t, uint8_t(*)(cpu_bus& t)> m_io_reads;
+    // Dispatch tables to map memory access functions for IO registers to virtual addresses,
+    //      indexed by AddressMirrors::CpuBus::io_index. Unmapped registers are left as nullptr
+    void(*m_io_writes[AddressMirrors::CpuBus::io_table_size])(cpu_bus& t, uint8_t value);
+    uint8_t(*m_io_reads[AddressMirrors::CpuBus::io_table_size])(cpu_bus& t);
 
     // Controller pointer
     Controller* m_ctrl;
@@ -36,6 +38,30 @@ private:
     // Game Genie
     GameGenie* m_gg;
 
+    // Page tables covering the whole CPU address space in 256 byte pages. Pages backed by
+    //      RAM or cartridge memory point straight at it, the rest (IO registers, mapper
+    //      registers, open bus) are nullptr and go through the full address decode
+    const uint8_t* m_read_pages[0x100];
+    uint8_t* m_write_pages[0x100];
+
+    // PRG pages 0x80 - 0xFF as the cartridge maps them. Pages with Game Genie patches are
+    //      left out of the read page table so their reads take the decode path, which still
+    //      reads the byte from here before handing it to the Game Genie
+    const uint8_t* m_cart_read_pages[0x80];
+
+    // Write pages the CPU has decoded code from, see Ricoh2A03::decode_block. They are left
+    //      out of the write page table so the decode path can drop the code before writing
+    uint8_t* m_code_pages[0x100];
+
+    // How often code decoded from each page was written over. Past self_modifying_writes
+    //      the page is assumed to be rewritten all the time and is just interpreted
+    static constexpr uint8_t self_modifying_writes = 8;
+    uint8_t m_code_writes[0x100];
+
+    // Full address decode for accesses that can't be served by the page tables
+    void decode_WB(uint16_t addr, uint8_t value);
+    uint8_t decode_RB(uint16_t addr);
+
 public:
 
     cpu_bus();
@@ -43,6 +69,10 @@ public:
     // Just something to keep track of elapsed cycles
     unsigned long long m_elapsed_clocks = 0;
 
+    // CPU cycle at which the PPU has to be caught up before anything could notice it
+    //      lagging behind, see sync_ppu
+    unsigned long long m_ppu_deadline = 0;
+
     // Connect controllers
     void connect_ctrl(Controller* ctrl_ptr);
 
@@ -54,17 +84,72 @@ public:
     // Connect Game Genie
     void connect_game_genie(GameGenie* gg_ptr);
 
-    // Memory access by CPU
-    void WB(uint16_t addr, uint8_t value);
-    uint8_t RB(uint16_t addr);
+    // Memory access by CPU, in the common case a single load or store through the page tables
+    inline void WB(uint16_t addr, uint8_t value) {
+        uint8_t* page = m_write_pages[addr >> 8];
+        if (page != nullptr) page[addr & 0xFF] = value;
+        else decode_WB(addr, value);
+    }
+    inline uint8_t RB(uint16_t addr) {
+        const uint8_t* page = m_read_pages[addr >> 8];
+        return page != nullptr ? page[addr & 0xFF] : decode_RB(addr);
+    }
+
+    // Read a byte without side effects, IO registers read as zero. For tracing and debugging
+    inline uint8_t peek(uint16_t addr) {
+        return (addr >= 0x2000 && addr <= 0x401F) ? 0x00 : RB(addr);
+    }
+
+    // The page's memory when the CPU can decode code from it ahead of time. That is ROM, or
+    //      RAM which can be protected from writes going around the block cache
+    inline const uint8_t* code_page(uint8_t page) {
+        const uint8_t* memory = m_read_pages[page];
+        if (m_code_writes[page] >= self_modifying_writes) return nullptr;
+        return (page >= 0x80 || m_write_pages[page] == memory || m_code_pages[page] == memory) ? memory : nullptr;
+    }
+
+    // Send writes to any CPU page backed by the memory through the decode path. False if
+    //      no page writes to it, the memory is ROM
+    bool protect_code(const uint8_t* memory);
+
+    // The 2 KiB of internal RAM, for looking at and poking from outside the emulation. Call
+    //      ram_changed after writing to it, code the CPU decoded from it is dropped
+    uint8_t* ram() { return m_ram.get(); }
+    void ram_changed();
+
+    // Refresh the cartridge pages of the page tables, called after the mapper switches banks
+    //      and whenever Game Genie codes are added
+    void remap_cart();
+
+    // A different rom was loaded into the cartridge, code decoded from the old one is dropped
+    //      along with the pages pointing into it
+    void cart_changed();
 
     // External signals
     void irq(); // Signal maskable interrupt to the cpu
+    void irq_release(); // Let go of the maskable interrupt again
     void nmi(); // Signal non-maskable interrupt to the cpu
     void rst(); // Signal reset to the cpu
 
-    // Step all components connected to the bus by a certain number of cycles
-    void step();
+    // Step all components connected to the bus by a certain number of cycles. The PPU
+    //      is only actually stepped once the deadline for its next event is reached
+    inline void step(uint8_t cycles) {
+        m_elapsed_clocks += cycles;
+        if (m_elapsed_clocks >= m_ppu_deadline) sync_ppu();
+    }
+
+    // Catch the PPU up to the CPU, at three dots per CPU cycle. This has to happen before
+    //      any access to PPU registers or mapper registers, and whenever the PPU is due to
+    //      raise NMI or complete a frame
+    void sync_ppu();
+
+    // Work out the deadline again, for when a write changed when the next event is. Besides
+    //      the PPU's own events that is the dot at which the mapper raises its next IRQ
+    void schedule_ppu();
+
+    // Save states, see state.hh. Loading drops any code the CPU decoded from RAM
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
 
 };
 
@@ -82,6 +167,9 @@ private:
     // A pointer to the cartridge as the PPU will need to read CHRROM
     Cart* m_cart;
 
+    // Pattern rows decoded on the fly when the cartridge can't provide them
+    uint8_t m_pattern_row[8];
+
 public:
 
     ppu_bus();
@@ -93,4 +181,15 @@ public:
     void WB(uint16_t addr, uint8_t value);
     uint8_t RB(uint16_t addr);
 
+    // Eight 2 bit color indices for the pattern row with its low bit plane at addr, taken
+    //      from the cartridge's decoded tiles where possible. Only valid until next called
+    const uint8_t* pattern_row(uint16_t addr, bool flip);
+
+    // Address line A12 rose, once a rendered scanline. Clocks the mapper's scanline counter
+    void clock_scanline();
+
+    // Save states, see state.hh
+    void save(StateWriter& state) const;
+    bool load(StateReader& state);
+
 };
@@ -29,6 +29,15 @@ namespace AddressMirrors {
             return addr < 0x4000 ? (addr & 0x7) | 0x2000 : addr;
         }
 
+        // Number of entries in the IO register dispatch tables
+        const int io_table_size = 0x28;
+
+        // Index into the IO dispatch tables for an address already reduced by mirror_io,
+        //      0x00 - 0x07 for 0x2000 - 0x2007 and 0x08 - 0x27 for 0x4000 - 0x401F
+        inline uint16_t io_index(uint16_t reduced_addr) {
+            return reduced_addr < 0x4000 ? reduced_addr & 0x7 : 0x08 + (reduced_addr & 0x1F);
+        }
+
     }
 
     namespace PpuBus {
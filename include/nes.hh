@@ -1,13 +1,18 @@
 #pragma once
-#include <SDL2/SDL.h>
 #include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
 #include "cart/cart.hh"
 #include "gamegenie.hh"
 #include "2A03.hh"
 #include "2C02.hh"
 #include "ctrl.hh"
 #include "memory.hh"
+#include "pacer.hh"
+#include "rewind.hh"
+#include "state.hh"
+#include "trace.hh"
 
 struct nes {
 
@@ -15,6 +20,9 @@ private:
 
     bool m_running;
 
+    // Running count of executed instructions, reported by headless runs
+    unsigned long long m_instructions;
+
     /* Components and Buslines ---------------------------- */
 
     // For cheat codes >:)
@@ -28,27 +36,140 @@ private:
     Ricoh2A03 m_cpu;
     Ricoh2C02 m_ppu;
 
-    // Cartridge
+    // Cartridge, and the file it was loaded from unless it came from memory
     Cart m_cart;
+    std::string m_rom_path;
 
     /* Controllers, subject to change --------------------- */
 
     Controller m_ctrl1;
 
-    /* For rendering and timing --------------------------- */
+    /* Instruction tracing, nullptr when not tracing ----- */
+
+    std::unique_ptr<TraceWriter> m_trace;
+    bool m_tracing; // The writer is tracing the CPU, T toggles this
+
+    /* Save states ---------------------------------------- */
+
+    // F5 saves the machine to this file and F7 loads it back, the rom path plus ".state"
+    std::string m_state_path;
+    std::vector<uint8_t> m_state;
+
+    // A state of the loaded cartridge to check the layout of others against before loading them,
+    //      saved the first time it's needed. Cleared when another rom is loaded
+    std::vector<uint8_t> m_layout;
+
+    bool save_state_file();
+    bool load_state_file();
+
+    /* Rewinding, nullptr when disabled ------------------- */
+
+    // Every frame is captured into the buffer while R is up, holding R plays them back
+    std::unique_ptr<Rewind> m_rewind;
+    bool m_rewinding;
+
+    // Time spent capturing frames, reported by headless runs
+    unsigned long long m_capture_ns;
+    unsigned long long m_captures;
+
+    void capture_rewind();
+    bool step_back();
+
+    /* Run ahead ------------------------------------------ */
+
+    // Frames emulated past the real one on the same input, the last of them is the one shown.
+    //      The machine is put back on the real frame before the next input is read
+    unsigned m_run_ahead;
+    std::vector<uint8_t> m_ahead;
 
-    std::chrono::time_point<std::chrono::system_clock> m_time;
-    SDL_Window   *m_window;
-    SDL_Renderer *m_renderer;
-    SDL_Texture  *m_texture;
+    // Time spent on the snapshot, the frames ahead and the restore, reported by headless runs
+    unsigned long long m_snapshot_ns;
+    unsigned long long m_ahead_ns;
+    unsigned long long m_restore_ns;
+    unsigned long long m_shown;
+
+    void advance_frame();
+    void restore_ahead();
+
+    /* For timing ----------------------------------------- */
+
+    // Keeps frames 1/60th of a second apart
+    FramePacer m_pacer;
+
+    // Emulate until the PPU signals that a frame has been completed
+    void step_frame();
+
+    // Individual micro benchmarks, see bench.cc
+    void bench_io();
+    void bench_hooks();
+    void bench_trace();
+    void bench_gamegenie();
+    void bench_dispatch();
+    void bench_state();
+    void bench_rewind();
+    void bench_run_ahead();
+    void bench_pacing();
+    void bench_load();
+    void bench_romdb();
+    void bench_mapper();
+    void bench_banks();
 
 public:
 
     nes();
 
     void add_cheat_code(const std::string& code);
+
+    // Trace every instruction with lo <= PC <= hi to a binary trace file, see trace.hh. The
+    //      CPU keeps running the way it does untraced, see Ricoh2A03::trace
+    bool start_trace(const std::string& path, uint16_t lo = 0x0000, uint16_t hi = 0xFFFF);
     bool load_cart(const std::string& rom_path);
+
+    // For embedding the emulator, see nescore.h. Load a rom image that is already in memory,
+    //      reset the machine, and emulate a frame with the buttons held (see Controller::set_buttons).
+    //      Writes to ram() are picked up by the next frame
+    bool load_cart(const uint8_t* rom, size_t size);
+    void reset();
+    bool cart_loaded() const { return m_cart.loaded(); }
+    void run_frame(uint8_t buttons);
+    const unsigned int* frame() const { return m_ppu.get_buf(); }
+    uint8_t* ram() { return m_cpu_bus.ram(); }
+
+    // Capture the whole machine into state, or put it back the way a state captured it,
+    //      see state.hh. A state that can't be loaded leaves the machine as it was
+    void save_state(std::vector<uint8_t>& state);
+    bool load_state(const std::vector<uint8_t>& state);
+
+    // Keep up to budget bytes of past frames to rewind through, 0 turns rewinding off
+    void enable_rewind(size_t budget);
+
+    // Show the frame this many frames ahead of the real one, 0 turns run ahead off
+    void run_ahead(unsigned frames);
+
+    // The SDL front end, see sdl/window.cc. Runs in a window in real time until it's closed,
+    //      with vsync frames are presented on the display's refresh rather than straight away
     void event_poll();
-    void run();
+    void run(bool vsync = false);
+
+    // Run a fixed number of frames as fast as possible without SDL, then
+    //      print throughput numbers. Optionally also prints a hash of every
+    //      frame rendered, to compare the output of two builds or renderers
+    void run_headless(unsigned long long frames, bool frame_hash = false);
+
+    // Run a fixed number of frames without SDL or any output, the controller following
+    //      recorded input rather than the keyboard. Returns the same hash as --frame-hash
+    uint64_t run_recorded(unsigned long long frames, const std::vector<InputEvent>& input);
+    unsigned long long instructions() const { return m_instructions; }
+
+    // Render every pixel on its own dot rather than a scanline at a time
+    void force_per_dot(bool per_dot);
+
+    // Pick the CPU's dispatch engine by name, call, switch or goto. Returns false for
+    //      anything else, see Ricoh2A03::Dispatch
+    bool force_dispatch(const std::string& engine);
+
+    // Run one of the micro benchmarks against the loaded cartridge, returns false
+    //      if there is no benchmark with the given name
+    bool benchmark(const std::string& name);
 
 };
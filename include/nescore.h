@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    libnescore, the emulator core behind a plain C API for driving it from other languages (ctypes, cgo
+    and the like). The library has no SDL in it, nothing is drawn or played: frames are run one at a time
+    and whatever they produced is read straight out of the machine. Build it with `make lib`.
+
+    Every machine is independent of the others, different machines may be used from different threads at
+    the same time but any one machine from only one thread at a time.
+
+    The API only ever grows. NESCORE_VERSION goes up when it does, nescore_version returns the version the
+    library was built with.
+*/
+
+#define NESCORE_VERSION 1
+
+// Frame buffer dimensions, in pixels
+#define NESCORE_WIDTH  256
+#define NESCORE_HEIGHT 240
+
+// Controller buttons, in the order the game reads them out
+#define NESCORE_A      0x01
+#define NESCORE_B      0x02
+#define NESCORE_SELECT 0x04
+#define NESCORE_START  0x08
+#define NESCORE_UP     0x10
+#define NESCORE_DOWN   0x20
+#define NESCORE_LEFT   0x40
+#define NESCORE_RIGHT  0x80
+
+#if defined(_WIN32)
+#define NESCORE_API __declspec(dllexport)
+#else
+#define NESCORE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nescore nescore;
+
+NESCORE_API int nescore_version(void);
+
+// A machine with no cartridge in it, NULL if out of memory
+NESCORE_API nescore* nescore_create(void);
+NESCORE_API void nescore_destroy(nescore* core);
+
+// Read a rom database (see romdb.txt) whose entries replace the headers of the roms in it. Load it
+//      before creating any machines. Returns 0 if the file can't be read
+NESCORE_API int nescore_load_romdb(const char* path);
+
+// Load an iNES or NES 2.0 image and reset the machine, the image is copied and can be freed afterwards.
+//      Returns 0 if the image isn't a rom or its mapper isn't supported, the machine then carries on
+//      with whatever rom it had
+NESCORE_API int nescore_load_rom(nescore* core, const void* rom, size_t size);
+
+// Press the reset button
+NESCORE_API void nescore_reset(nescore* core);
+
+// Emulate one frame with the buttons held down on the first controller, a mask of NESCORE_A and co.
+//      Does nothing while there is no rom loaded
+NESCORE_API void nescore_step_frame(nescore* core, uint8_t buttons);
+
+// The last frame, NESCORE_WIDTH * NESCORE_HEIGHT pixels a row at a time. Pixels are 32 bits, red in
+//      the lowest byte then green, blue and alpha (RGBA8888 on little endian hosts). Points into the
+//      machine itself, the contents are only good until the next frame is stepped
+NESCORE_API const uint32_t* nescore_framebuffer(const nescore* core);
+
+// The 2 KiB of internal RAM, $0000 - $07FF. Can be written to between frames
+NESCORE_API uint8_t* nescore_ram(nescore* core, size_t* size);
+
+// Instructions executed since the rom was loaded or the machine was reset
+NESCORE_API unsigned long long nescore_instructions(const nescore* core);
+
+// Save states. nescore_save_state returns the size of the state, and only writes it to buffer if
+//      it fits in capacity, so it can be called with a NULL buffer to find out how big it is first.
+//      nescore_load_state returns 0 and leaves the machine alone if the state can't be loaded
+NESCORE_API size_t nescore_save_state(nescore* core, void* buffer, size_t capacity);
+NESCORE_API int nescore_load_state(nescore* core, const void* state, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
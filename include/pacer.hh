@@ -0,0 +1,46 @@
+#pragma once
+#include <chrono>
+
+/*
+    Frame pacing. Every frame has an absolute deadline on the monotonic clock, one period after the
+    last one, so time spent emulating and rendering never adds up to drift. Waiting for a deadline
+    sleeps until shortly before it and only spins for what is left, the margin being however late the
+    sleeps have been waking up recently. Falling more than a frame behind (the debugger, a window being
+    dragged about) starts over from the current time rather than rushing to catch up.
+*/
+
+class FramePacer {
+
+public:
+
+    using clock = std::chrono::steady_clock;
+
+    FramePacer(std::chrono::nanoseconds period);
+
+    // The first deadline is one period from now
+    void start();
+
+    // Block until the current deadline, then move on to the next
+    void wait();
+
+    // Frames waited for, how many of them were missed entirely and the time spent sleeping
+    //      and spinning in total
+    unsigned long long frames() const { return m_frames; }
+    unsigned long long missed() const { return m_missed; }
+    std::chrono::nanoseconds slept() const { return m_slept; }
+    std::chrono::nanoseconds spun() const { return m_spun; }
+
+private:
+
+    std::chrono::nanoseconds m_period;
+    clock::time_point m_deadline;
+
+    // How far ahead of the deadline sleeping stops, follows how late sleeps wake up
+    std::chrono::nanoseconds m_margin;
+
+    unsigned long long m_frames, m_missed;
+    std::chrono::nanoseconds m_slept, m_spun;
+
+    static void sleep_until(clock::time_point when);
+
+};
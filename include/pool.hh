@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+    Work stealing thread pool. Each worker has a queue of its own that tasks are dealt out to round robin,
+    it works through that queue from the front and only goes looking through the other workers' queues,
+    taking from the back, once its own is empty. Workers therefore hardly ever touch the same
+    queue, and one that drew a run of short tasks helps out the ones stuck with long ones instead of
+    sitting idle at the end.
+
+    Meant for batches of independent tasks that are all known up front, there is no submitting more
+    tasks while a batch is running.
+*/
+
+class WorkStealingPool {
+
+public:
+
+    using Task = std::function<void()>;
+
+    WorkStealingPool(unsigned threads);
+
+    // Run every task and return once all of them have finished. The calling thread is one of the
+    //      workers, so a pool of one thread runs everything in order on the caller
+    void run(std::vector<Task>& tasks);
+
+    unsigned threads() const { return m_threads; }
+
+    // Tasks that ran on a different worker from the one they were dealt to, during the last run
+    unsigned long long stolen() const { return m_stolen.load(); }
+
+private:
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+    };
+
+    unsigned m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<unsigned long long> m_stolen;
+
+    void work(unsigned worker);
+    Task* take(unsigned worker, bool& stolen);
+
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/*
+    Rewind buffer. Holds a save state (see state.hh) for every frame of the last however many seconds fit
+    in the memory budget. Only the newest state is kept whole, every older one is stored as the difference
+    to the state after it: the two XORed together, which is almost all zero bytes from one frame to the
+    next, with the runs of zeros squeezed out. Popping the newest state applies the difference to get the
+    one before it back, so the buffer plays backwards one frame per pop.
+
+    Each difference is encoded as a sequence of runs, a LEB128 count of unchanged bytes followed by a
+    LEB128 count of changed bytes and then those changed bytes XORed with the newer state.
+*/
+
+struct Rewind {
+
+private:
+
+    // Bytes the differences may take up before the oldest ones are dropped
+    size_t m_budget;
+    size_t m_used;
+
+    std::vector<uint8_t> m_newest;
+    std::deque<std::vector<uint8_t>> m_deltas; // Oldest first
+
+    // A dropped difference's storage, reused for the next one
+    std::vector<uint8_t> m_spare;
+
+    static void encode(const std::vector<uint8_t>& older, const std::vector<uint8_t>& newer, std::vector<uint8_t>& delta);
+    static void apply(std::vector<uint8_t>& state, const std::vector<uint8_t>& delta);
+
+public:
+
+    Rewind(size_t budget);
+
+    // Add the state a frame is about to be emulated from
+    void push(const std::vector<uint8_t>& state);
+
+    // Take the newest state off the buffer, false once there is nothing left to rewind
+    bool pop(std::vector<uint8_t>& state);
+
+    // The newest state, leaving it on the buffer. False if there is none
+    bool peek(std::vector<uint8_t>& state) const;
+
+    void clear();
+
+    // Frames that can be rewound and the memory they take up
+    size_t frames() const { return m_newest.empty() ? 0 : m_deltas.size() + 1; }
+    size_t bytes() const { return m_used + m_newest.size(); }
+
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "2C02.hh"
+
+/*
+    Triple buffered frames. The emulation draws into the back buffer and the display reads from the front
+    one, and the two only ever meet over the middle buffer: publishing a frame swaps the back buffer with
+    the middle one and marks it fresh, acquiring a frame swaps a fresh middle buffer with the front one.
+    Both swaps are a single atomic exchange, so neither side ever waits on the other and the display never
+    sees a frame that is still being drawn.
+
+    A frame published over one that was never acquired is dropped, acquiring with nothing fresh shows the
+    last frame again.
+*/
+
+class TripleBuffer {
+
+public:
+
+    TripleBuffer();
+
+    // Emulation side, the buffer to draw the next frame into
+    unsigned int* back() { return m_buffers[m_back].get(); }
+
+    // Emulation side, hand over the finished back buffer and get the next one to draw into
+    unsigned int* publish();
+
+    // Display side, the newest frame. Sets fresh to whether it wasn't acquired before
+    const unsigned int* acquire(bool& fresh);
+
+    // Whether a frame has been published and not acquired yet
+    bool fresh() const { return m_middle.load(std::memory_order_acquire) & fresh_bit; }
+
+    unsigned long long published() const { return m_published; }
+    unsigned long long dropped() const { return m_dropped; }
+    unsigned long long duplicated() const { return m_duplicated; }
+
+private:
+
+    static const int fresh_bit = 4;
+
+    std::unique_ptr<unsigned int[]> m_buffers[3];
+
+    // Index of the middle buffer plus the fresh bit. Back and front are each only ever
+    //      touched by their own side
+    std::atomic<int> m_middle;
+    int m_back, m_front;
+
+    // Counted by the side that notices, so each one only has a single writer
+    std::atomic<unsigned long long> m_published, m_dropped, m_duplicated;
+
+};
+
+/*
+    Presentation thread. Takes frames out of a triple buffer and puts them on the window, the renderer
+    and texture it does this with are created and used on that thread only. Without vsync it waits for
+    each new frame, with vsync it presents on every refresh, showing the last frame again whenever
+    the emulation hasn't got the next one ready in time. Drivers that don't do vsync present straight
+    away, which is noticed and falls back to waiting for frames.
+*/
+
+class Presenter {
+
+public:
+
+    Presenter(SDL_Window* window, bool vsync);
+
+    // Stops the thread once it's done with the frame it's on
+    ~Presenter();
+
+    TripleBuffer& frames() { return m_frames; }
+
+    // Publish the frame in the back buffer, returns the buffer to draw the next one into
+    unsigned int* publish();
+
+private:
+
+    TripleBuffer m_frames;
+
+    SDL_Window* m_window;
+
+    // Turned off again if presenting turns out not to wait for the refresh after all
+    std::atomic<bool> m_vsync;
+
+    // Only used to sleep on while there is nothing fresh to present
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_done;
+
+    std::thread m_thread;
+
+    void present();
+
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Vectorized kernels for the hottest parts of the PPU. Each one has a plain C++ version that
+//      works everywhere, the fastest version the host supports is picked at startup
+namespace Simd {
+
+    // Draw the 8 pixels of a sprite row over a line of the frame buffer, pixel i is drawn when
+    //      bit i of draw is set. Sprites behind the background are only drawn over pixels that
+    //      are transparent background, meaning their alpha bit 0x01000000 is clear
+    extern void (*composite_sprite)(unsigned int* line, const unsigned int* row, uint8_t draw, bool behind_bg);
+
+    // Look up count palette indices in lut and write the resulting colors to out
+    extern void (*resolve_line)(unsigned int* out, const uint8_t* indices, const unsigned int* lut, int count);
+
+    // Switch the kernels above to the given instruction set, "scalar", "sse2" or "avx2".
+    //      Returns false if it is unknown or unsupported by this host
+    bool use(const std::string& isa);
+
+    // Name of the instruction set currently in use
+    const std::string& selected();
+
+}
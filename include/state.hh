@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/*
+    Save states. A state is a flat binary blob: an 8 byte magic "NESSTATE" and a 32 bit format version,
+    followed by one section per component in a fixed order. Each section is a four character tag, its
+    size in bytes and then whatever fields the component saves, copied as they are in memory. States are
+    only meant to be loaded by the build that saved them, bump state_version whenever a section changes.
+
+    Components save and load themselves (see save / load on each of them), opening their own section so a
+    state that doesn't match what is expected is caught at the section it goes wrong in.
+*/
+
+static constexpr uint32_t state_version = 4;
+
+struct StateWriter {
+
+private:
+
+    std::vector<uint8_t>& m_data;
+
+    // Offset of the size field of the section being written, 0 before the first one
+    size_t m_section;
+
+    void close_section();
+
+public:
+
+    // Writes the header into data, replacing whatever it held. The buffer's capacity is
+    //      kept, so saving into the same vector over and over doesn't allocate
+    StateWriter(std::vector<uint8_t>& data);
+
+    // Start the next section, closes the one before it. tag is four characters
+    void section(const char* tag);
+
+    // Close the last section, the state is complete after this
+    void finish();
+
+    void bytes(const void* data, size_t size);
+
+    template<typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be copied into a state");
+        bytes(&value, sizeof(T));
+    }
+
+};
+
+struct StateReader {
+
+private:
+
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    const uint8_t* m_section_end;
+
+    uint32_t m_version;
+
+    // Cleared by the first read that fails, everything after it fails too
+    bool m_ok;
+
+public:
+
+    // Checks the header, see ok
+    StateReader(const std::vector<uint8_t>& data);
+
+    // Enter the next section, false if it isn't tagged tag or anything is left unread
+    //      in the one before it
+    bool section(const char* tag);
+
+    // Check the last section was read to its end
+    bool finish();
+
+    // Skip ahead to the section tagged tag and enter it, false if there is none
+    bool find(const char* tag);
+
+    // Whether two states are made of the same sections with the same sizes, in which case
+    //      anything that can load one can load the other as far as its layout goes
+    static bool same_layout(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b);
+
+    bool bytes(void* data, size_t size);
+
+    template<typename T>
+    bool get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be copied out of a state");
+        return bytes(&value, sizeof(T));
+    }
+
+    bool ok() const { return m_ok; }
+    uint32_t version() const { return m_version; }
+
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include "hooks.hh"
+
+struct cpu_bus;
+struct Ricoh2C02;
+
+/*
+    Binary instruction trace. Given to the CPU as its tracer (Ricoh2A03::trace), every executed instruction
+    (optionally only those within a PC range) is packed into a fixed size record and pushed onto a single
+    producer single consumer ring. A background thread drains the ring into the trace file in large
+    blocks, so the emulation thread never touches the file itself.
+
+    File layout, all little endian: an 8 byte magic "NESTRACE", a 32 bit format version and a 32 bit
+    record size, followed by records. testing/trace2txt.py converts a trace to text.
+*/
+
+struct TraceRecord {
+    uint64_t cycle;        // CPU cycles since power on, at the start of the instruction
+    uint16_t pc;
+    int16_t  scanline;     // PPU position at the start of the instruction
+    uint16_t dot;
+    uint8_t  a, x, y, p, s;
+    uint8_t  bytes[3];     // Opcode and the two bytes after it, whether they are operands or not
+    uint8_t  reserved[2];
+};
+static_assert(sizeof(TraceRecord) == 24, "trace records are 24 bytes on disk");
+
+class TraceWriter : public Instrumentation {
+
+public:
+
+    // Opens the trace file and starts the writer thread, check is_open afterwards. Only
+    //      instructions with lo <= PC <= hi are traced
+    TraceWriter(const std::string& path, cpu_bus* bus, Ricoh2C02* ppu, uint16_t lo = 0x0000, uint16_t hi = 0xFFFF);
+
+    // Drains whatever is left in the ring and closes the file
+    ~TraceWriter();
+
+    bool is_open() const { return m_file != nullptr; }
+
+    void cpu_instruction(const CpuContext& ctx) override;
+
+    // Records traced so far, and how often the emulation had to wait on a full ring
+    unsigned long long records() const { return m_head.load(std::memory_order_relaxed); }
+    unsigned long long stalls() const { return m_stalls; }
+
+private:
+
+    // Power of two so positions can be masked rather than wrapped
+    static const size_t ring_size = 1 << 16;
+    std::unique_ptr<TraceRecord[]> m_ring;
+
+    // Free running positions, the emulation thread only writes head and the writer thread only
+    //      writes tail. Kept on separate cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    alignas(64) std::atomic<bool>   m_done;
+
+    unsigned long long m_stalls;
+
+    FILE* m_file;
+    std::thread m_thread;
+
+    cpu_bus* m_bus;
+    Ricoh2C02* m_ppu;
+    uint16_t m_lo, m_hi;
+
+    // Body of the writer thread
+    void drain();
+
+};
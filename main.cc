@@ -1,15 +1,82 @@
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
+#include "batch.hh"
+#include "cart/romdb.hh"
 #include "nes.hh"
+#include "simd.hh"
 
 int main(int argc, char** argv) {
 
+    // The rom database sits next to the executable unless given with --romdb, see romdb.hh
+    std::string romdb = std::string(argv[0]).substr(0, std::string(argv[0]).find_last_of('/') + 1) + "romdb.txt";
+    bool romdb_given = false;
+    for (int i = 1; i + 1 < argc; i++)
+        if (std::string(argv[i]) == "--romdb") { romdb = argv[i + 1]; romdb_given = true; }
+    if (!RomDb::load(romdb) && romdb_given)
+        std::cout << "Rom database could not be read: " << romdb << std::endl;
+
+    // Batch runs take a job file in place of the rom, see batch.hh
+    if (argc > 2 && std::string(argv[1]) == "--batch") {
+        unsigned threads = std::thread::hardware_concurrency();
+        for (int i = 3; i + 1 < argc; i++)
+            if (std::string(argv[i]) == "--threads") threads = std::stoul(argv[++i]);
+        return run_batch(argv[2], threads) ? 0 : 1;
+    }
+
+    // Options may follow the rom path, anything else is treated as a cheat code
+    bool headless = false, frame_hash = false, per_dot = false, vsync = false;
+    unsigned long long frames = 600;
+    std::string bench, trace, dispatch;
+    uint16_t trace_lo = 0x0000, trace_hi = 0xFFFF;
+    unsigned run_ahead = 0;
+    long rewind_mb = -1; // Defaults to 20 MiB, off in headless runs unless asked for
+    std::vector<std::string> codes;
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--headless") headless = true;
+        else if (arg == "--frames" && i + 1 < argc) frames = std::stoull(argv[++i]);
+        else if (arg == "--bench" && i + 1 < argc) { bench = argv[++i]; headless = true; }
+        else if (arg == "--frame-hash") { frame_hash = true; headless = true; }
+        else if (arg == "--per-dot") per_dot = true;
+        else if (arg == "--dispatch" && i + 1 < argc) dispatch = argv[++i];
+        else if (arg == "--vsync") vsync = true;
+        else if (arg == "--trace" && i + 1 < argc) trace = argv[++i];
+        else if (arg == "--trace-range" && i + 1 < argc) {
+            // Inclusive range of hex addresses, LO-HI
+            std::string range(argv[++i]);
+            trace_lo = std::stoul(range.substr(0, range.find('-')), nullptr, 16);
+            trace_hi = std::stoul(range.substr(range.find('-') + 1), nullptr, 16);
+        }
+        else if (arg == "--rewind-mb" && i + 1 < argc) rewind_mb = std::stol(argv[++i]);
+        else if (arg == "--run-ahead" && i + 1 < argc) {
+            run_ahead = std::stoul(argv[++i]);
+            if (run_ahead > 4) { std::cout << "Run ahead is limited to 4 frames" << std::endl; run_ahead = 4; }
+        }
+        else if (arg == "--romdb" && i + 1 < argc) i++; // Loaded above
+        else if (arg == "--simd" && i + 1 < argc) {
+            if (!Simd::use(argv[++i])) std::cout << "Unsupported SIMD kernels: " << argv[i] << std::endl;
+        }
+        else codes.push_back(arg);
+    }
+
     nes emulator;
-    if (argv[1] != nullptr && emulator.load_cart(argv[1]))
+    if (argc > 1 && emulator.load_cart(argv[1]))
     {
-        for (int i = 2; i < argc; i++)
-            emulator.add_cheat_code(std::string(argv[i]));
-        emulator.run();
+        for (const std::string& code : codes)
+            emulator.add_cheat_code(code);
+        emulator.force_per_dot(per_dot);
+        if (!dispatch.empty() && !emulator.force_dispatch(dispatch))
+            std::cout << "Unknown dispatch engine: " << dispatch << std::endl;
+        if (!trace.empty()) emulator.start_trace(trace, trace_lo, trace_hi);
+        if (rewind_mb < 0) rewind_mb = headless ? 0 : 20;
+        emulator.enable_rewind((size_t)rewind_mb << 20);
+        emulator.run_ahead(run_ahead);
+
+        if (!bench.empty()) emulator.benchmark(bench);
+        else if (headless) emulator.run_headless(frames, frame_hash);
+        else emulator.run(vsync);
     }
     else std::cout << "Failed to load rom" << std::endl;
 
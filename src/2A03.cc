@@ -5,6 +5,16 @@ Ricoh2A03::Ricoh2A03() {
     // Reset internal interrupt flags
     m_nmi_requested = m_irq_requested = false;
 
+    // Nothing is instrumented until something is attached
+    m_hooks = nullptr;
+    m_tracer = nullptr;
+
+    // Nothing has been decoded yet
+    flush_blocks();
+
+    // The fastest dispatch the compiler can do
+    m_dispatch = has_computed_goto ? GOTO : SWITCH;
+
 }
 
 /* Busline connections ------------------------------------ */
@@ -13,39 +23,104 @@ void Ricoh2A03::connect_bus(cpu_bus* cpu_bus_ptr) {
     m_bus = cpu_bus_ptr;
 }
 
+void Ricoh2A03::attach(Instrumentation* sink) {
+    m_hooks = sink;
+}
+
+void Ricoh2A03::trace(Instrumentation* tracer) {
+    m_tracer = tracer;
+}
+
 /* Memory access to the cpu buslines ---------------------- */
 
+template<typename Hooks>
 void Ricoh2A03::WB(uint16_t addr, uint8_t value) {
 
     // Handle break on address write
-    #ifdef DEBUG
-    Debugger::get().do_break(addr, wr);
-    #endif
+    Hooks::cpu_access(m_hooks, addr, wr);
 
     m_bus->WB(addr, value);
 }
 
+template<typename Hooks>
 uint8_t Ricoh2A03::RB(uint16_t addr) {
     
     // Handle break on address read
-    #ifdef DEBUG
-    Debugger::get().do_break(addr, rd);
-    #endif
+    Hooks::cpu_access(m_hooks, addr, rd);
 
     return m_bus->RB(addr);
 }
 
+template<typename Hooks, bool Decoded>
+uint8_t Ricoh2A03::fetch(int n) {
+
+    // The PC still steps over operands that were decoded ahead of time
+    if constexpr (Decoded) {
+        ++m_reg_pc;
+        return m_operands[n];
+    }
+    else return RB<Hooks>(m_reg_pc++);
+}
+
+
+/* Save states -------------------------------------------- */
+
+void Ricoh2A03::save(StateWriter& state) const {
+
+    state.section("CPU ");
+    state.put(m_reg_a); state.put(m_reg_x);
+    state.put(m_reg_y); state.put(m_reg_s);
+    state.put(get_p()); state.put(m_reg_pc);
+    state.put(m_irq_requested); state.put(m_nmi_requested);
+
+}
+
+bool Ricoh2A03::load(StateReader& state) {
+
+    uint8_t p = 0;
+    state.section("CPU ");
+    state.get(m_reg_a); state.get(m_reg_x);
+    state.get(m_reg_y); state.get(m_reg_s);
+    state.get(p); state.get(m_reg_pc);
+    state.get(m_irq_requested); state.get(m_nmi_requested);
+    set_p(p);
+
+    // RAM the blocks were decoded from has been replaced, ROM is the same
+    flush_ram_blocks();
+
+    return state.ok();
+}
+
+/* Status register ---------------------------------------- */
+
+uint8_t Ricoh2A03::get_p() const {
+    return (m_reg_p & 0x3C) | m_flag_c | (flag_z() << 1) | (m_flag_v << 6) | (flag_n() << 7);
+}
+
+void Ricoh2A03::set_p(uint8_t value) {
+    m_reg_p = value;
+    m_flag_c = value & 0x01;
+    m_flag_v = value & 0x40;
+    m_zn = ((value & 0x02) ? 0x0000 : 0x0001) | ((value & 0x80) << 8);
+}
 
 /* External signals --------------------------------------- */
 
 void Ricoh2A03::irq() {
 
     // Indicates that an irq interrupt should occur after the completion
-    //      of this instruction
+    //      of this instruction, or once interrupts are enabled again
     m_irq_requested = true;
 
 }
 
+void Ricoh2A03::irq_release() {
+
+    // Whatever held the line acknowledged its interrupt
+    m_irq_requested = false;
+
+}
+
 void Ricoh2A03::nmi() {
 
     // Indicates that an nmi interrupt should occur after the completion
@@ -62,34 +137,37 @@ void Ricoh2A03::rst() {
     // Reset registers
     m_reg_a = 0x00; m_reg_x = 0x00;
     m_reg_y = 0x00; m_reg_s = 0xFD;
-    m_reg_p = 0x00;
+    set_p(0x00);
 
     // Initialize the PC to entry point
-    m_reg_pc = RB(0xFFFC) | (RB(0xFFFD) << 8);
+    if (m_hooks != nullptr)
+        m_reg_pc = RB<Hooks::Instrumented>(0xFFFC) | (RB<Hooks::Instrumented>(0xFFFD) << 8);
+    else m_reg_pc = RB<Hooks::Release>(0xFFFC) | (RB<Hooks::Release>(0xFFFD) << 8);
 
 }
 
 /* Interrupt handling ------------------------------------- */
 
+template<typename Hooks>
 void Ricoh2A03::do_interrupt(uint16_t addr) {
 
     // Push PC to stack
-    WB(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
-    WB(0x0100 + m_reg_s--, m_reg_pc & 0xFF);
+    WB<Hooks>(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
+    WB<Hooks>(0x0100 + m_reg_s--, m_reg_pc & 0xFF);
 
-    // Push status to stack
-    m_flag_b = false; m_flag_i = true;
-    WB(0x0100 + m_reg_s--, m_reg_p); 
+    // Push status to stack, as it was before the interrupt. Interrupts are only
+    //      disabled afterwards, so returning from the handler enables them again
+    m_flag_b = false;
+    WB<Hooks>(0x0100 + m_reg_s--, get_p()); 
+    m_flag_i = true;
 
     // Jump to fetched jump address
-    m_reg_pc  = RB(addr++);
-    m_reg_pc |= (RB(addr) << 8);
+    m_reg_pc  = RB<Hooks>(addr++);
+    m_reg_pc |= (RB<Hooks>(addr) << 8);
 
     // Do execution breakpoint, debugger will skip over any
     //      address at this point if it is not checked here
-    #ifdef DEBUG
-    Debugger::get().do_break(m_reg_pc, ex);
-    #endif
+    Hooks::cpu_access(m_hooks, m_reg_pc, ex);
 
 }
 
@@ -102,13 +180,15 @@ void Ricoh2A03::do_interrupt(uint16_t addr) {
 // Will be used to construct a jump table that is indexed by the 
 //      opcode for CPU instruction execution
 // ---------------------------------------------------------------
+//    Hooks -> hook policy     - from hooks.hh
+//  Decoded -> operands come from m_operands, see the block cache
 //      a_m -> addressing mode - from Ricoh2A03 member enum
 //      op  -> operation       - from Ricoh2A03 member enum
 //  Returns -> uint8_t         - any additional cycles used
 // ---------------------------------------------------------------
 // I give lots of credit to https://github.com/OneLoneCoder as I 
 //      referenced his code often to make this template
-template<Ricoh2A03::AddrModes a_m, Ricoh2A03::Operations op>
+template<typename Hooks, bool Decoded, Ricoh2A03::AddrModes a_m, Ricoh2A03::Operations op>
 uint8_t Ricoh2A03::ins() {
 
     // A boolean flag to determine if an additional cycle
@@ -119,33 +199,38 @@ uint8_t Ricoh2A03::ins() {
     uint16_t addr_abs = 0x0000, addr_rel = 0x0000, t16 = 0x0000;
     uint8_t t8 = 0, extra_cycles = 0;
 
+    // Whether the addressing mode leaves the operand in t8, otherwise it is read from addr_abs
+    constexpr bool operand_in_t8 = a_m == IMP || (a_m == IMM && Decoded);
+
     // Do addressing mode
     if constexpr (a_m == IMP) {
         t8 = m_reg_a;
     }
     else if constexpr (a_m == IMM) {
-        addr_abs = m_reg_pc++;
+        // A decoded block already holds the value, read through the bus when it was decoded
+        if constexpr (Decoded) t8 = fetch<Hooks,Decoded>(0);
+        else addr_abs = m_reg_pc++;
     }
     else if constexpr (a_m == ZP0) {
-        addr_abs = RB(m_reg_pc++) & 0x00FF;
+        addr_abs = fetch<Hooks,Decoded>(0) & 0x00FF;
     }
     else if constexpr (a_m == ZPX) {
-        addr_abs = (RB(m_reg_pc++) + m_reg_x) & 0x00FF;
+        addr_abs = (fetch<Hooks,Decoded>(0) + m_reg_x) & 0x00FF;
     }
     else if constexpr (a_m == ZPY) {
-        addr_abs = (RB(m_reg_pc++) + m_reg_y) & 0x00FF;
+        addr_abs = (fetch<Hooks,Decoded>(0) + m_reg_y) & 0x00FF;
     }
     else if constexpr (a_m == REL) {
-        addr_rel = RB(m_reg_pc++);
+        addr_rel = fetch<Hooks,Decoded>(0);
         if (addr_rel & 0x80) addr_rel |= 0xFF00;
     }
     else if constexpr (a_m == ABS) {
-        addr_abs  = RB(m_reg_pc++);
-        addr_abs |= (RB(m_reg_pc++) << 8);
+        addr_abs  = fetch<Hooks,Decoded>(0);
+        addr_abs |= (fetch<Hooks,Decoded>(1) << 8);
     }
     else if constexpr (a_m == ABX) {
-        uint8_t lo = RB(m_reg_pc++);
-        uint8_t hi = RB(m_reg_pc++);
+        uint8_t lo = fetch<Hooks,Decoded>(0);
+        uint8_t hi = fetch<Hooks,Decoded>(1);
         addr_abs = ((hi << 8) | lo) + m_reg_x;
         // Specific instructions will check addrmode_extra_cycle to see if it needs the
         //      additional cycle to handle the page cross, other instructions just do
@@ -154,29 +239,29 @@ uint8_t Ricoh2A03::ins() {
             addrmode_extra_cycle = true;
     }
     else if constexpr (a_m == ABY) {
-        uint8_t lo = RB(m_reg_pc++);
-        uint8_t hi = RB(m_reg_pc++);
+        uint8_t lo = fetch<Hooks,Decoded>(0);
+        uint8_t hi = fetch<Hooks,Decoded>(1);
         addr_abs = ((hi << 8) | lo) + m_reg_y;
         // Same rational as ABX
         if ((addr_abs & 0xFF00) != (hi << 8))
             addrmode_extra_cycle = true;
     }
     else if constexpr (a_m == IND) {
-        uint16_t rd_addr = RB(m_reg_pc++);
-        rd_addr |=  (RB(m_reg_pc++) << 8);
+        uint16_t rd_addr = fetch<Hooks,Decoded>(0);
+        rd_addr |=  (fetch<Hooks,Decoded>(1) << 8);
         addr_abs = (rd_addr & 0x00FF) == 0xFF ?
-            (RB(rd_addr & 0xFF00) << 8) | RB(rd_addr): // Hardware bug on page boundaries
-            (RB(rd_addr + 0x0001) << 8) | RB(rd_addr); // Regular behavior
+            (RB<Hooks>(rd_addr & 0xFF00) << 8) | RB<Hooks>(rd_addr): // Hardware bug on page boundaries
+            (RB<Hooks>(rd_addr + 0x0001) << 8) | RB<Hooks>(rd_addr); // Regular behavior
     }
     else if constexpr (a_m == IZX) {
-        uint16_t rd_addr = RB(m_reg_pc++);
-        addr_abs  = RB((uint16_t)(rd_addr + (uint16_t)m_reg_x    ) & 0x00FF);
-        addr_abs |= RB((uint16_t)(rd_addr + (uint16_t)m_reg_x + 1) & 0x00FF) << 8;
+        uint16_t rd_addr = fetch<Hooks,Decoded>(0);
+        addr_abs  = RB<Hooks>((uint16_t)(rd_addr + (uint16_t)m_reg_x    ) & 0x00FF);
+        addr_abs |= RB<Hooks>((uint16_t)(rd_addr + (uint16_t)m_reg_x + 1) & 0x00FF) << 8;
     }
     else if constexpr (a_m == IZY) {
-        uint16_t rd_addr = RB(m_reg_pc++);
-        uint8_t  lo = RB( rd_addr      & 0x00FF);
-        uint8_t  hi = RB((rd_addr + 1) & 0x00FF);
+        uint16_t rd_addr = fetch<Hooks,Decoded>(0);
+        uint8_t  lo = RB<Hooks>( rd_addr      & 0x00FF);
+        uint8_t  hi = RB<Hooks>((rd_addr + 1) & 0x00FF);
         addr_abs = ((hi << 8) | lo) + m_reg_y;
         // Page change potential to add cycle like before
         if ((addr_abs & 0xFF00) != (hi << 8))
@@ -186,41 +271,38 @@ uint8_t Ricoh2A03::ins() {
     // Do operation
     if constexpr (op == ADC) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)m_reg_a + (uint16_t)t8 + (uint16_t)m_flag_c;
 
         m_flag_c = (t16 > 0xFF);
-        m_flag_z = (t16 & 0xFF) == 0;
+        m_zn = t16 & 0xFF;
         m_flag_v = (~((uint16_t)m_reg_a^(uint16_t)t8)&((uint16_t)m_reg_a^(uint16_t)t16))&0x0080;
-        m_flag_n = t16 & 0x80;
 
         m_reg_a = t16 & 0xFF;
         if (addrmode_extra_cycle) ++extra_cycles;
     }
     else if constexpr (op == AND) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_a &= t8;
 
-        m_flag_z = (m_reg_a == 0);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == ASL) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)t8 << 1;
         
         m_flag_c = (t16 & 0xFF00) > 0;
-        m_flag_z = (t16 & 0x00FF) == 0;
-        m_flag_n = (t16 & 0x0080);
+        m_zn = t16 & 0xFF;
 
         if constexpr (a_m == IMP)
             m_reg_a = t16 & 0x00FF;
 
-        else WB(addr_abs, t16 & 0x00FF);
+        else WB<Hooks>(addr_abs, t16 & 0x00FF);
 
     }
     else if constexpr (op == BCC) {
@@ -251,7 +333,7 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == BEQ) {
 
-        if (m_flag_z) {
+        if (flag_z()) {
             ++extra_cycles;
             addr_abs = addr_rel + m_reg_pc;
 
@@ -264,18 +346,18 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == BIT) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = m_reg_a & t8;
 
-        m_flag_z = (t16 & 0xFF) == 0;
-        m_flag_n = t8 & 0x80;
+        // Z comes from A & M but N from M itself, see m_zn
+        m_zn = (t16 & 0xFF) | ((t8 & 0x80) << 8);
         m_flag_v = t8 & 0x40;
 
     }
     else if constexpr (op == BMI) { // I can reduce the code reuse for these branches
                                     //     will likely come back to this
 
-        if (m_flag_n) {
+        if (flag_n()) {
             ++extra_cycles;
             addr_abs = addr_rel + m_reg_pc;
 
@@ -288,7 +370,7 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == BNE) {
 
-        if (!m_flag_z) {
+        if (!flag_z()) {
             ++extra_cycles;
             addr_abs = addr_rel + m_reg_pc;
 
@@ -301,7 +383,7 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == BPL) {
 
-        if (!m_flag_n) {
+        if (!flag_n()) {
             ++extra_cycles;
             addr_abs = addr_rel + m_reg_pc;
 
@@ -314,13 +396,13 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == BRK) {
 
-        WB(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
-        WB(0x0100 + m_reg_s--, m_reg_pc & 0xFF);
+        WB<Hooks>(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
+        WB<Hooks>(0x0100 + m_reg_s--, m_reg_pc & 0xFF);
         
-        WB(0x100 + m_reg_s--, m_reg_p | 0x30);
+        WB<Hooks>(0x100 + m_reg_s--, get_p() | 0x30);
         m_flag_b = false; m_flag_i = true;
 
-        m_reg_pc = (uint16_t)RB(0xFFFE) | ((uint16_t)RB(0xFFFF) << 8);
+        m_reg_pc = (uint16_t)RB<Hooks>(0xFFFE) | ((uint16_t)RB<Hooks>(0xFFFF) << 8);
 
     }
     else if constexpr (op == BVC) {
@@ -371,93 +453,83 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == CMP) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)m_reg_a - (uint16_t)t8;
 
         m_flag_c = m_reg_a >= t8;
-        m_flag_z = (t16 & 0x00FF) == 0;
-        m_flag_n = t16 & 0x0080;
+        m_zn = t16 & 0xFF;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == CPX) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)m_reg_x - (uint16_t)t8;
 
         m_flag_c = (m_reg_x >= t8);
-        m_flag_z = (t16 & 0x00FF) == 0;
-        m_flag_n = (t16 & 0x0080);
+        m_zn = t16 & 0xFF;
 
     }
     else if constexpr (op == CPY) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)m_reg_y - (uint16_t)t8;
 
         m_flag_c = (m_reg_y >= t8);
-        m_flag_z = (t16 & 0x00FF) == 0;
-        m_flag_n = (t16 & 0x0080);
+        m_zn = t16 & 0xFF;
 
     }
     else if constexpr (op == DEC) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = t8 - 1;
 
-        WB(addr_abs, t16 & 0x00FF);
-        m_flag_z = (t16 & 0xFF) == 0;
-        m_flag_n = t16 & 0x80;
+        WB<Hooks>(addr_abs, t16 & 0x00FF);
+        m_zn = t16 & 0xFF;
 
     }
     else if constexpr (op == DEX) {
 
         m_reg_x = m_reg_x - 1;
-        m_flag_z = (m_reg_x == 0x00);
-        m_flag_n = (m_reg_x & 0x80);
+        m_zn = m_reg_x;
 
     }
     else if constexpr (op == DEY) {
 
         m_reg_y = m_reg_y - 1;
-        m_flag_z = (m_reg_y == 0x00);
-        m_flag_n = (m_reg_y & 0x80);
+        m_zn = m_reg_y;
 
     }
     else if constexpr (op == EOR) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_a ^= t8;
 
-        m_flag_z = (m_reg_a == 0x00);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == INC) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = t8 + 1;
 
-        WB(addr_abs, t16 & 0x00FF);
-        m_flag_z = (t16 & 0xFF) == 0;
-        m_flag_n = t16 & 0x80;
+        WB<Hooks>(addr_abs, t16 & 0x00FF);
+        m_zn = t16 & 0xFF;
 
     }
     else if constexpr (op == INX) {
 
         m_reg_x++;
-        m_flag_z = (m_reg_x == 0x00);
-        m_flag_n = (m_reg_x & 0x80);
+        m_zn = m_reg_x;
 
     }
     else if constexpr (op == INY) {
 
         m_reg_y++;
-        m_flag_z = (m_reg_y == 0x00);
-        m_flag_n = (m_reg_y & 0x80);
+        m_zn = m_reg_y;
 
     }
     else if constexpr (op == JMP) {
@@ -468,57 +540,53 @@ uint8_t Ricoh2A03::ins() {
     else if constexpr (op == JSR) {
 
         --m_reg_pc;
-        WB(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
-        WB(0x0100 + m_reg_s--,  m_reg_pc       & 0xFF);
+        WB<Hooks>(0x0100 + m_reg_s--, (m_reg_pc >> 8) & 0xFF);
+        WB<Hooks>(0x0100 + m_reg_s--,  m_reg_pc       & 0xFF);
         m_reg_pc = addr_abs;
 
     }
     else if constexpr (op == LDA) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_a = t8;
 
-        m_flag_z = (m_reg_a == 0x00);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == LDX) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_x = t8;
 
-        m_flag_z = (m_reg_x == 0x00);
-        m_flag_n = (m_reg_x & 0x80);
+        m_zn = m_reg_x;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == LDY) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_y = t8;
 
-        m_flag_z = (m_reg_y == 0x00);
-        m_flag_n = (m_reg_y & 0x80);
+        m_zn = m_reg_y;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == LSR) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = t8 >> 1;
         
         m_flag_c = t8 & 0x01;
-        m_flag_z = (t16 & 0x00FF) == 0;
-        m_flag_n = (t16 & 0x0080);
+        m_zn = t16 & 0xFF;
 
         if constexpr (a_m == IMP)
             m_reg_a = t16 & 0x00FF;
 
-        else WB(addr_abs, t16 & 0x00FF);
+        else WB<Hooks>(addr_abs, t16 & 0x00FF);
 
     }
     else if constexpr (op == NOP) {
@@ -528,92 +596,87 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == ORA) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         m_reg_a |= t8;
 
-        m_flag_z = (m_reg_a == 0x00);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
         if (addrmode_extra_cycle) ++extra_cycles;
 
     }
     else if constexpr (op == PHA) {
 
-        WB(0x0100 + m_reg_s--, m_reg_a);
+        WB<Hooks>(0x0100 + m_reg_s--, m_reg_a);
 
     }
     else if constexpr (op == PHP) {
 
-        WB(0x0100 + m_reg_s--, m_reg_p | 0x30);
+        WB<Hooks>(0x0100 + m_reg_s--, get_p() | 0x30);
         m_reg_p &= 0xCF;
 
     }
     else if constexpr (op == PLA) {
 
-        m_reg_a = RB(++m_reg_s + 0x0100);
-        m_flag_z = m_reg_a == 0x00;
-        m_flag_n = m_reg_a & 0x80;
+        m_reg_a = RB<Hooks>(++m_reg_s + 0x0100);
+        m_zn = m_reg_a;
 
     }
     else if constexpr (op == PLP) {
 
-        m_reg_p = RB(++m_reg_s + 0x0100) | 0x20;
+        set_p(RB<Hooks>(++m_reg_s + 0x0100) | 0x20);
 
     }
     else if constexpr (op == ROL) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)(t8 << 1) | (uint16_t)m_flag_c;
 
         m_flag_c = (t16 & 0xFF00);
-        m_flag_z = ((t16 & 0x00FF) == 0);
-        m_flag_n = (t16 & 0x0080);
+        m_zn = t16 & 0xFF;
 
         if constexpr (a_m == IMP)
             m_reg_a = t16 & 0x00FF;
         
-        else WB(addr_abs, t16 & 0x00FF);
+        else WB<Hooks>(addr_abs, t16 & 0x00FF);
     
     }
     else if constexpr (op == ROR) {
 
-        if constexpr (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         t16 = (uint16_t)(m_flag_c << 7) | (t8 >> 1);
 
         m_flag_c = t8 & 0x01;
-        m_flag_z = (t16 & 0xFF) == 0;
-        m_flag_n = t16 & 0x80;
+        m_zn = t16 & 0xFF;
 
         if constexpr (a_m == IMP)
             m_reg_a = t16 & 0x00FF;
 
-        else WB(addr_abs, t16 & 0x00FF); 
+        else WB<Hooks>(addr_abs, t16 & 0x00FF); 
 
     }
     else if constexpr (op == RTI) {
 
-        m_reg_p = RB(++m_reg_s + 0x0100) & 0xCF;
-        m_reg_pc  = (uint16_t)RB(++m_reg_s + 0x0100);
-        m_reg_pc |= (uint16_t)RB(++m_reg_s + 0x0100) << 8;
+        set_p(RB<Hooks>(++m_reg_s + 0x0100) & 0xCF);
+        m_reg_pc  = (uint16_t)RB<Hooks>(++m_reg_s + 0x0100);
+        m_reg_pc |= (uint16_t)RB<Hooks>(++m_reg_s + 0x0100) << 8;
 
     }
     else if constexpr (op == RTS) {
 
-        m_reg_pc  = (uint16_t)RB(++m_reg_s + 0x0100);
-        m_reg_pc |= (uint16_t)RB(++m_reg_s + 0x0100) << 8;
+        m_reg_pc  = (uint16_t)RB<Hooks>(++m_reg_s + 0x0100);
+        m_reg_pc |= (uint16_t)RB<Hooks>(++m_reg_s + 0x0100) << 8;
         ++m_reg_pc;
 
     }
     else if constexpr (op == SBC) {
 
-        if (a_m != IMP) t8 = RB(addr_abs);
+        if constexpr (!operand_in_t8) t8 = RB<Hooks>(addr_abs);
         uint16_t val = ((uint16_t)t8) ^ 0x00FF;
 
         t16 = (uint16_t)m_reg_a + val + (uint16_t)m_flag_c;
         m_flag_c = (t16 & 0xFF00);
-        m_flag_z = (t16 & 0x00FF) == 0;
+        m_zn = t16 & 0xFF;
         m_flag_v = (t16 ^ (uint16_t)m_reg_a) & (t16 ^ val) & 0x80;
-        m_flag_n = (t16 & 0x0080);
         m_reg_a = t16 & 0xFF;
 
         if (addrmode_extra_cycle) ++extra_cycles;
@@ -636,45 +699,41 @@ uint8_t Ricoh2A03::ins() {
     }
     else if constexpr (op == STA) {
 
-        WB(addr_abs, m_reg_a);
+        WB<Hooks>(addr_abs, m_reg_a);
 
     }
     else if constexpr (op == STX) {
 
-        WB(addr_abs, m_reg_x);
+        WB<Hooks>(addr_abs, m_reg_x);
 
     }
     else if constexpr (op == STY) {
 
-        WB(addr_abs, m_reg_y);
+        WB<Hooks>(addr_abs, m_reg_y);
 
     }
     else if constexpr (op == TAX) {
         
         m_reg_x = m_reg_a;
-        m_flag_z = (m_reg_x == 0x00);
-        m_flag_n = (m_reg_x & 0x80);
+        m_zn = m_reg_x;
 
     }
     else if constexpr (op == TAY) {
 
         m_reg_y = m_reg_a;
-        m_flag_z = (m_reg_y == 0x00);
-        m_flag_n = (m_reg_y & 0x80);
+        m_zn = m_reg_y;
 
     }
     else if constexpr (op == TSX) {
 
         m_reg_x = m_reg_s;
-        m_flag_z = (m_reg_x == 0x00);
-        m_flag_n = (m_reg_x & 0x80);
+        m_zn = m_reg_x;
 
     }
     else if constexpr (op == TXA) {
 
         m_reg_a = m_reg_x;
-        m_flag_z = (m_reg_a == 0x00);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
     }
     else if constexpr (op == TXS) {
@@ -685,8 +744,7 @@ uint8_t Ricoh2A03::ins() {
     else if constexpr (op == TYA) {
 
         m_reg_a = m_reg_y;
-        m_flag_z = (m_reg_a == 0x00);
-        m_flag_n = (m_reg_a & 0x80);
+        m_zn = m_reg_a;
 
     }
 
@@ -695,36 +753,98 @@ uint8_t Ricoh2A03::ins() {
 
 uint8_t Ricoh2A03::step() {
 
-    typedef struct { 
-        uint8_t (Ricoh2A03::*fn)(); // Instruction function function pointer
-        uint8_t len;                // Base length of instruction in cycles
-    } instruction;
-    
-    #define a(a_m, op, cyc) \
-        { &Ricoh2A03::ins<a_m,op>, cyc }
-    // Lookup table of function pointers, indexed by opcode to get 
-    //      the instruction to execute ... 
-    static const instruction lookup[0x100] = 
-    {
-    /* ~Dorceless~        0x-0          0x-1          0x-2          0x-3          0x-4          0x-5          0x-6          0x-7          0x-8          0x-9          0x-A          0x-B          0x-C          0x-D          0x-E          0x-F */ 
-        /* 0x0- */ a(IMM,BRK,7), a(IZX,ORA,6), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,3), a(ZP0,ORA,3), a(ZP0,ASL,5), a(IMP,NOP,5), a(IMP,PHP,3), a(IMM,ORA,2), a(IMP,ASL,2), a(IMP,NOP,2), a(IMP,NOP,4), a(ABS,ORA,4), a(ABS,ASL,6), a(IMP,NOP,6),
-        /* 0x1- */ a(REL,BPL,2), a(IZY,ORA,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,ORA,4), a(ZPX,ASL,6), a(IMP,NOP,6), a(IMP,CLC,2), a(ABY,ORA,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,ORA,4), a(ABX,ASL,7), a(IMP,NOP,7),
-        /* 0x2- */ a(ABS,JSR,6), a(IZX,AND,6), a(IMP,NOP,2), a(IMP,NOP,8), a(ZP0,BIT,3), a(ZP0,AND,3), a(ZP0,ROL,5), a(IMP,NOP,5), a(IMP,PLP,4), a(IMM,AND,2), a(IMP,ROL,2), a(IMP,NOP,2), a(ABS,BIT,4), a(ABS,AND,4), a(ABS,ROL,6), a(IMP,NOP,6),
-        /* 0x3- */ a(REL,BMI,2), a(IZY,AND,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,AND,4), a(ZPX,ROL,6), a(IMP,NOP,6), a(IMP,SEC,2), a(ABY,AND,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,AND,4), a(ABX,ROL,7), a(IMP,NOP,7),
-        /* 0x4- */ a(IMP,RTI,6), a(IZX,EOR,6), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,3), a(ZP0,EOR,3), a(ZP0,LSR,5), a(IMP,NOP,5), a(IMP,PHA,3), a(IMM,EOR,2), a(IMP,LSR,2), a(IMP,NOP,2), a(ABS,JMP,3), a(ABS,EOR,4), a(ABS,LSR,6), a(IMP,NOP,6),
-        /* 0x5- */ a(REL,BVC,2), a(IZY,EOR,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,EOR,4), a(ZPX,LSR,6), a(IMP,NOP,6), a(IMP,CLI,2), a(ABY,EOR,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,EOR,4), a(ABX,LSR,7), a(IMP,NOP,7),
-        /* 0x6- */ a(IMP,RTS,6), a(IZX,ADC,6), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,3), a(ZP0,ADC,3), a(ZP0,ROR,5), a(IMP,NOP,5), a(IMP,PLA,4), a(IMM,ADC,2), a(IMP,ROR,2), a(IMP,NOP,2), a(IND,JMP,5), a(ABS,ADC,4), a(ABS,ROR,6), a(IMP,NOP,6),
-        /* 0x7- */ a(REL,BVS,2), a(IZY,ADC,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,ADC,4), a(ZPX,ROR,6), a(IMP,NOP,6), a(IMP,SEI,2), a(ABY,ADC,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,ADC,4), a(ABX,ROR,7), a(IMP,NOP,7),
-        /* 0x8- */ a(IMP,NOP,2), a(IZX,STA,6), a(IMP,NOP,2), a(IMP,NOP,6), a(ZP0,STY,3), a(ZP0,STA,3), a(ZP0,STX,3), a(IMP,NOP,3), a(IMP,DEY,2), a(IMP,NOP,2), a(IMP,TXA,2), a(IMP,NOP,2), a(ABS,STY,4), a(ABS,STA,4), a(ABS,STX,4), a(IMP,NOP,4),
-        /* 0x9- */ a(REL,BCC,2), a(IZY,STA,6), a(IMP,NOP,2), a(IMP,NOP,6), a(ZPX,STY,4), a(ZPX,STA,4), a(ZPY,STX,4), a(IMP,NOP,4), a(IMP,TYA,2), a(ABY,STA,5), a(IMP,TXS,2), a(IMP,NOP,5), a(IMP,NOP,5), a(ABX,STA,5), a(IMP,NOP,5), a(IMP,NOP,5),
-        /* 0xA- */ a(IMM,LDY,2), a(IZX,LDA,6), a(IMM,LDX,2), a(IMP,NOP,6), a(ZP0,LDY,3), a(ZP0,LDA,3), a(ZP0,LDX,3), a(IMP,NOP,3), a(IMP,TAY,2), a(IMM,LDA,2), a(IMP,TAX,2), a(IMP,NOP,2), a(ABS,LDY,4), a(ABS,LDA,4), a(ABS,LDX,4), a(IMP,NOP,4),
-        /* 0xB- */ a(REL,BCS,2), a(IZY,LDA,5), a(IMP,NOP,2), a(IMP,NOP,5), a(ZPX,LDY,4), a(ZPX,LDA,4), a(ZPY,LDX,4), a(IMP,NOP,4), a(IMP,CLV,2), a(ABY,LDA,4), a(IMP,TSX,2), a(IMP,NOP,4), a(ABX,LDY,4), a(ABX,LDA,4), a(ABY,LDX,4), a(IMP,NOP,4),
-        /* 0xC- */ a(IMM,CPY,2), a(IZX,CMP,6), a(IMP,NOP,2), a(IMP,NOP,8), a(ZP0,CPY,3), a(ZP0,CMP,3), a(ZP0,DEC,5), a(IMP,NOP,5), a(IMP,INY,2), a(IMM,CMP,2), a(IMP,DEX,2), a(IMP,NOP,2), a(ABS,CPY,4), a(ABS,CMP,4), a(ABS,DEC,6), a(IMP,NOP,6),
-        /* 0xD- */ a(REL,BNE,2), a(IZY,CMP,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,CMP,4), a(ZPX,DEC,6), a(IMP,NOP,6), a(IMP,CLD,2), a(ABY,CMP,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,CMP,4), a(ABX,DEC,7), a(IMP,NOP,7),
-        /* 0xE- */ a(IMM,CPX,2), a(IZX,SBC,6), a(IMP,NOP,2), a(IMP,NOP,8), a(ZP0,CPX,3), a(ZP0,SBC,3), a(ZP0,INC,5), a(IMP,NOP,5), a(IMP,INX,2), a(IMM,SBC,2), a(IMP,NOP,2), a(IMP,SBC,2), a(ABS,CPX,4), a(ABS,SBC,4), a(ABS,INC,6), a(IMP,NOP,6),
-        /* 0xF- */ a(REL,BEQ,2), a(IZY,SBC,5), a(IMP,NOP,2), a(IMP,NOP,8), a(IMP,NOP,4), a(ZPX,SBC,4), a(ZPX,INC,6), a(IMP,NOP,6), a(IMP,SED,2), a(ABY,SBC,4), a(IMP,NOP,2), a(IMP,NOP,7), a(IMP,NOP,4), a(ABX,SBC,4), a(ABX,INC,7), a(IMP,NOP,7),
-    };
-    #undef a
+    // Only pay for the hooks when something is listening
+    if (m_hooks != nullptr)
+        return m_tracer != nullptr ? step_impl<Hooks::Instrumented, Hooks::Traced>() : step_impl<Hooks::Instrumented>();
+    return m_tracer != nullptr ? step_impl<Hooks::Release, Hooks::Traced>() : step_impl<Hooks::Release>();
+
+}
+
+unsigned Ricoh2A03::run(unsigned budget) {
+
+    // Hooks are called between instructions, one step at a time is all they can do
+    if (m_hooks != nullptr) {
+        unsigned executed = 0;
+        unsigned long long end = m_bus->m_elapsed_clocks + budget;
+        do {
+            m_bus->step(step());
+            ++executed;
+        } while (m_bus->m_elapsed_clocks < end);
+        return executed;
+    }
+
+    // A trace only looks at instructions as they start, it keeps the engine
+    if (m_tracer != nullptr) switch (m_dispatch) {
+        case CALL:   return run_impl<CALL, Hooks::Traced>(budget);
+        case SWITCH: return run_impl<SWITCH, Hooks::Traced>(budget);
+        case GOTO:   return run_impl<GOTO, Hooks::Traced>(budget);
+    }
+
+    switch (m_dispatch) {
+        case CALL:   return run_impl<CALL, Hooks::Release>(budget);
+        case SWITCH: return run_impl<SWITCH, Hooks::Release>(budget);
+        case GOTO:   return run_impl<GOTO, Hooks::Release>(budget);
+    }
+    return 0;
+
+}
+
+void Ricoh2A03::dispatch(Dispatch engine) {
+
+    // Without labels as values the switch is the closest thing
+    m_dispatch = (engine == GOTO && !has_computed_goto) ? SWITCH : engine;
+
+}
+
+// Every opcode with its addressing mode, operation and base length in cycles, as
+//      a(opcode, a_m, op, cyc). Expanded into the lookup tables and dispatch engines
+#define OPCODE_TABLE(a) \
+        /* 0x0- */ a(0x00,IMM,BRK,7) a(0x01,IZX,ORA,6) a(0x02,IMP,NOP,2) a(0x03,IMP,NOP,8) a(0x04,IMP,NOP,3) a(0x05,ZP0,ORA,3) a(0x06,ZP0,ASL,5) a(0x07,IMP,NOP,5) a(0x08,IMP,PHP,3) a(0x09,IMM,ORA,2) a(0x0A,IMP,ASL,2) a(0x0B,IMP,NOP,2) a(0x0C,IMP,NOP,4) a(0x0D,ABS,ORA,4) a(0x0E,ABS,ASL,6) a(0x0F,IMP,NOP,6) \
+        /* 0x1- */ a(0x10,REL,BPL,2) a(0x11,IZY,ORA,5) a(0x12,IMP,NOP,2) a(0x13,IMP,NOP,8) a(0x14,IMP,NOP,4) a(0x15,ZPX,ORA,4) a(0x16,ZPX,ASL,6) a(0x17,IMP,NOP,6) a(0x18,IMP,CLC,2) a(0x19,ABY,ORA,4) a(0x1A,IMP,NOP,2) a(0x1B,IMP,NOP,7) a(0x1C,IMP,NOP,4) a(0x1D,ABX,ORA,4) a(0x1E,ABX,ASL,7) a(0x1F,IMP,NOP,7) \
+        /* 0x2- */ a(0x20,ABS,JSR,6) a(0x21,IZX,AND,6) a(0x22,IMP,NOP,2) a(0x23,IMP,NOP,8) a(0x24,ZP0,BIT,3) a(0x25,ZP0,AND,3) a(0x26,ZP0,ROL,5) a(0x27,IMP,NOP,5) a(0x28,IMP,PLP,4) a(0x29,IMM,AND,2) a(0x2A,IMP,ROL,2) a(0x2B,IMP,NOP,2) a(0x2C,ABS,BIT,4) a(0x2D,ABS,AND,4) a(0x2E,ABS,ROL,6) a(0x2F,IMP,NOP,6) \
+        /* 0x3- */ a(0x30,REL,BMI,2) a(0x31,IZY,AND,5) a(0x32,IMP,NOP,2) a(0x33,IMP,NOP,8) a(0x34,IMP,NOP,4) a(0x35,ZPX,AND,4) a(0x36,ZPX,ROL,6) a(0x37,IMP,NOP,6) a(0x38,IMP,SEC,2) a(0x39,ABY,AND,4) a(0x3A,IMP,NOP,2) a(0x3B,IMP,NOP,7) a(0x3C,IMP,NOP,4) a(0x3D,ABX,AND,4) a(0x3E,ABX,ROL,7) a(0x3F,IMP,NOP,7) \
+        /* 0x4- */ a(0x40,IMP,RTI,6) a(0x41,IZX,EOR,6) a(0x42,IMP,NOP,2) a(0x43,IMP,NOP,8) a(0x44,IMP,NOP,3) a(0x45,ZP0,EOR,3) a(0x46,ZP0,LSR,5) a(0x47,IMP,NOP,5) a(0x48,IMP,PHA,3) a(0x49,IMM,EOR,2) a(0x4A,IMP,LSR,2) a(0x4B,IMP,NOP,2) a(0x4C,ABS,JMP,3) a(0x4D,ABS,EOR,4) a(0x4E,ABS,LSR,6) a(0x4F,IMP,NOP,6) \
+        /* 0x5- */ a(0x50,REL,BVC,2) a(0x51,IZY,EOR,5) a(0x52,IMP,NOP,2) a(0x53,IMP,NOP,8) a(0x54,IMP,NOP,4) a(0x55,ZPX,EOR,4) a(0x56,ZPX,LSR,6) a(0x57,IMP,NOP,6) a(0x58,IMP,CLI,2) a(0x59,ABY,EOR,4) a(0x5A,IMP,NOP,2) a(0x5B,IMP,NOP,7) a(0x5C,IMP,NOP,4) a(0x5D,ABX,EOR,4) a(0x5E,ABX,LSR,7) a(0x5F,IMP,NOP,7) \
+        /* 0x6- */ a(0x60,IMP,RTS,6) a(0x61,IZX,ADC,6) a(0x62,IMP,NOP,2) a(0x63,IMP,NOP,8) a(0x64,IMP,NOP,3) a(0x65,ZP0,ADC,3) a(0x66,ZP0,ROR,5) a(0x67,IMP,NOP,5) a(0x68,IMP,PLA,4) a(0x69,IMM,ADC,2) a(0x6A,IMP,ROR,2) a(0x6B,IMP,NOP,2) a(0x6C,IND,JMP,5) a(0x6D,ABS,ADC,4) a(0x6E,ABS,ROR,6) a(0x6F,IMP,NOP,6) \
+        /* 0x7- */ a(0x70,REL,BVS,2) a(0x71,IZY,ADC,5) a(0x72,IMP,NOP,2) a(0x73,IMP,NOP,8) a(0x74,IMP,NOP,4) a(0x75,ZPX,ADC,4) a(0x76,ZPX,ROR,6) a(0x77,IMP,NOP,6) a(0x78,IMP,SEI,2) a(0x79,ABY,ADC,4) a(0x7A,IMP,NOP,2) a(0x7B,IMP,NOP,7) a(0x7C,IMP,NOP,4) a(0x7D,ABX,ADC,4) a(0x7E,ABX,ROR,7) a(0x7F,IMP,NOP,7) \
+        /* 0x8- */ a(0x80,IMP,NOP,2) a(0x81,IZX,STA,6) a(0x82,IMP,NOP,2) a(0x83,IMP,NOP,6) a(0x84,ZP0,STY,3) a(0x85,ZP0,STA,3) a(0x86,ZP0,STX,3) a(0x87,IMP,NOP,3) a(0x88,IMP,DEY,2) a(0x89,IMP,NOP,2) a(0x8A,IMP,TXA,2) a(0x8B,IMP,NOP,2) a(0x8C,ABS,STY,4) a(0x8D,ABS,STA,4) a(0x8E,ABS,STX,4) a(0x8F,IMP,NOP,4) \
+        /* 0x9- */ a(0x90,REL,BCC,2) a(0x91,IZY,STA,6) a(0x92,IMP,NOP,2) a(0x93,IMP,NOP,6) a(0x94,ZPX,STY,4) a(0x95,ZPX,STA,4) a(0x96,ZPY,STX,4) a(0x97,IMP,NOP,4) a(0x98,IMP,TYA,2) a(0x99,ABY,STA,5) a(0x9A,IMP,TXS,2) a(0x9B,IMP,NOP,5) a(0x9C,IMP,NOP,5) a(0x9D,ABX,STA,5) a(0x9E,IMP,NOP,5) a(0x9F,IMP,NOP,5) \
+        /* 0xA- */ a(0xA0,IMM,LDY,2) a(0xA1,IZX,LDA,6) a(0xA2,IMM,LDX,2) a(0xA3,IMP,NOP,6) a(0xA4,ZP0,LDY,3) a(0xA5,ZP0,LDA,3) a(0xA6,ZP0,LDX,3) a(0xA7,IMP,NOP,3) a(0xA8,IMP,TAY,2) a(0xA9,IMM,LDA,2) a(0xAA,IMP,TAX,2) a(0xAB,IMP,NOP,2) a(0xAC,ABS,LDY,4) a(0xAD,ABS,LDA,4) a(0xAE,ABS,LDX,4) a(0xAF,IMP,NOP,4) \
+        /* 0xB- */ a(0xB0,REL,BCS,2) a(0xB1,IZY,LDA,5) a(0xB2,IMP,NOP,2) a(0xB3,IMP,NOP,5) a(0xB4,ZPX,LDY,4) a(0xB5,ZPX,LDA,4) a(0xB6,ZPY,LDX,4) a(0xB7,IMP,NOP,4) a(0xB8,IMP,CLV,2) a(0xB9,ABY,LDA,4) a(0xBA,IMP,TSX,2) a(0xBB,IMP,NOP,4) a(0xBC,ABX,LDY,4) a(0xBD,ABX,LDA,4) a(0xBE,ABY,LDX,4) a(0xBF,IMP,NOP,4) \
+        /* 0xC- */ a(0xC0,IMM,CPY,2) a(0xC1,IZX,CMP,6) a(0xC2,IMP,NOP,2) a(0xC3,IMP,NOP,8) a(0xC4,ZP0,CPY,3) a(0xC5,ZP0,CMP,3) a(0xC6,ZP0,DEC,5) a(0xC7,IMP,NOP,5) a(0xC8,IMP,INY,2) a(0xC9,IMM,CMP,2) a(0xCA,IMP,DEX,2) a(0xCB,IMP,NOP,2) a(0xCC,ABS,CPY,4) a(0xCD,ABS,CMP,4) a(0xCE,ABS,DEC,6) a(0xCF,IMP,NOP,6) \
+        /* 0xD- */ a(0xD0,REL,BNE,2) a(0xD1,IZY,CMP,5) a(0xD2,IMP,NOP,2) a(0xD3,IMP,NOP,8) a(0xD4,IMP,NOP,4) a(0xD5,ZPX,CMP,4) a(0xD6,ZPX,DEC,6) a(0xD7,IMP,NOP,6) a(0xD8,IMP,CLD,2) a(0xD9,ABY,CMP,4) a(0xDA,IMP,NOP,2) a(0xDB,IMP,NOP,7) a(0xDC,IMP,NOP,4) a(0xDD,ABX,CMP,4) a(0xDE,ABX,DEC,7) a(0xDF,IMP,NOP,7) \
+        /* 0xE- */ a(0xE0,IMM,CPX,2) a(0xE1,IZX,SBC,6) a(0xE2,IMP,NOP,2) a(0xE3,IMP,NOP,8) a(0xE4,ZP0,CPX,3) a(0xE5,ZP0,SBC,3) a(0xE6,ZP0,INC,5) a(0xE7,IMP,NOP,5) a(0xE8,IMP,INX,2) a(0xE9,IMM,SBC,2) a(0xEA,IMP,NOP,2) a(0xEB,IMP,SBC,2) a(0xEC,ABS,CPX,4) a(0xED,ABS,SBC,4) a(0xEE,ABS,INC,6) a(0xEF,IMP,NOP,6) \
+        /* 0xF- */ a(0xF0,REL,BEQ,2) a(0xF1,IZY,SBC,5) a(0xF2,IMP,NOP,2) a(0xF3,IMP,NOP,8) a(0xF4,IMP,NOP,4) a(0xF5,ZPX,SBC,4) a(0xF6,ZPX,INC,6) a(0xF7,IMP,NOP,6) a(0xF8,IMP,SED,2) a(0xF9,ABY,SBC,4) a(0xFA,IMP,NOP,2) a(0xFB,IMP,NOP,7) a(0xFC,IMP,NOP,4) a(0xFD,ABX,SBC,4) a(0xFE,ABX,INC,7) a(0xFF,IMP,NOP,7)
+
+template<typename Hooks, typename Trace>
+uint8_t Ricoh2A03::step_impl() {
+
+    uint8_t extra_cycles = interrupts<Hooks>();
+    Trace::cpu_instruction(m_tracer, context(m_bus->m_elapsed_clocks + extra_cycles));
+
+    // Run the instruction from the block cache when it has been decoded ahead of time.
+    //      Hooks want to see every operand fetch, so they always go through the bus
+    if constexpr (!Hooks::enabled) {
+        if (const MicroOp* op = next_op()) {
+
+            // Writing to the code may drop the block mid instruction, keep what's needed
+            uint8_t (Ricoh2A03::*fn)() = op->fn;
+            uint8_t len = op->len;
+
+            m_operands[0] = op->operands[0];
+            m_operands[1] = op->operands[1];
+            ++m_reg_pc;
+            extra_cycles += (this->*fn)();
+
+            return extra_cycles + len;
+        }
+    }
+
+    return interpret<Hooks>(extra_cycles);
+}
+
+template<typename Hooks>
+uint8_t Ricoh2A03::interrupts() {
 
     uint8_t extra_cycles = 0;
 
@@ -732,42 +852,262 @@ uint8_t Ricoh2A03::step() {
     //      and add any additional cycles used to service it
     if (m_nmi_requested) {
         
-        do_interrupt(0xFFFA); 
+        do_interrupt<Hooks>(0xFFFA); 
 
         // assuming both irq and nmi are pending after an instruction, nmi
-        //      takes priority and irq is forgotten
-        m_nmi_requested = m_irq_requested = false;
+        //      takes priority. It disables interrupts, so irq waits for the
+        //      handler to return if the line is still held by then
+        m_nmi_requested = false;
 
         extra_cycles += 7;
     }
-    if (m_irq_requested) {
+    else if (m_irq_requested && !m_flag_i) {
 
-        do_interrupt(0xFFFE); 
+        // The line stays held until the mapper is acknowledged, the handler
+        //      runs with interrupts disabled so it isn't entered again
+        do_interrupt<Hooks>(0xFFFE); 
 
-        m_irq_requested = false;
         extra_cycles += 7;
     }
 
+    return extra_cycles;
+}
+
+template<typename Hooks>
+uint8_t Ricoh2A03::interpret(uint8_t extra_cycles) {
+
+    typedef struct { 
+        uint8_t (Ricoh2A03::*fn)(); // Instruction function function pointer
+        uint8_t len;                // Base length of instruction in cycles
+    } instruction;
+    
+    #define a(opcode, a_m, op, cyc) \
+        { &Ricoh2A03::ins<Hooks,false,a_m,op>, cyc },
+    // Lookup table of function pointers, indexed by opcode to get 
+    //      the instruction to execute ... 
+    static const instruction lookup[0x100] = { OPCODE_TABLE(a) };
+    #undef a
+
+    // Let anything tracing execution see the state the instruction starts from
+    if constexpr (Hooks::enabled)
+        Hooks::cpu_instruction(m_hooks, context(m_bus->m_elapsed_clocks + extra_cycles));
+
     // Read an opcode and execute the corresponding instruction, add
     //      any extra cycles consumed during instruction execution
-    const instruction& i = lookup[RB(m_reg_pc++)];
+    const instruction& i = lookup[RB<Hooks>(m_reg_pc++)];
     extra_cycles += (this->*i.fn)();
 
-    // Update debug info
-    #ifdef DEBUG
-    CpuContext ctx = {
+    // Update debug info, this also handles execution breakpoints
+    if constexpr (Hooks::enabled)
+        Hooks::cpu_step(m_hooks, context(m_bus->m_elapsed_clocks + extra_cycles + i.len));
+
+    // Return the total number of cycles used
+    return extra_cycles + i.len;
+}
+
+CpuContext Ricoh2A03::context(unsigned long long cycle) const {
+
+    return CpuContext {
         .reg_a  = m_reg_a,
         .reg_x  = m_reg_x,
         .reg_y  = m_reg_y,
         .reg_s  = m_reg_s,
-        .reg_p  = m_reg_p,
-        .reg_pc = m_reg_pc
+        .reg_p  = get_p(),
+        .reg_pc = m_reg_pc,
+        .cycle  = cycle
     };
-    Debugger::get().set_cpu_context(ctx); 
-    // Handle execution breakpoints
-    Debugger::get().do_break(m_reg_pc, ex);
-    #endif
 
-    // Return the total number of cycles used
-    return extra_cycles + i.len;
+}
+
+template<Ricoh2A03::Dispatch engine, typename Trace>
+unsigned Ricoh2A03::run_impl(unsigned budget) {
+
+    // Measured on the bus, OAM DMA steps it in the middle of an instruction
+    unsigned executed = 0;
+    unsigned long long end = m_bus->m_elapsed_clocks + budget;
+
+    do {
+
+        uint8_t cycles = interrupts<Hooks::Release>();
+        Trace::cpu_instruction(m_tracer, context(m_bus->m_elapsed_clocks + cycles));
+
+        // Anything the block cache can't provide is interpreted from the bus
+        const MicroOp* op = next_op();
+        if (op == nullptr) cycles = interpret<Hooks::Release>(cycles);
+        else {
+
+            // Writing to the code may drop the block mid instruction, keep what's needed
+            uint8_t opcode = op->opcode;
+            uint8_t (Ricoh2A03::*fn)() = op->fn;
+            uint8_t len = op->len;
+
+            m_operands[0] = op->operands[0];
+            m_operands[1] = op->operands[1];
+            ++m_reg_pc;
+
+            // The same indirect call step makes
+            if constexpr (engine == CALL) {
+                cycles += (this->*fn)() + len;
+            }
+
+            // Every instruction inlined into one big switch
+            else if constexpr (engine == SWITCH || !has_computed_goto) {
+                #define a(opcode, a_m, op, cyc) \
+                    case opcode: cycles += ins<Hooks::Release,true,a_m,op>() + cyc; break;
+                switch (opcode) { OPCODE_TABLE(a) }
+                #undef a
+            }
+
+            // Same again, jumping straight to the instruction through a table of labels
+            #if defined(__GNUC__)
+            else {
+                #define a(opcode, a_m, op, cyc) &&op_##opcode,
+                static const void* labels[0x100] = { OPCODE_TABLE(a) };
+                #undef a
+
+                goto *labels[opcode];
+                #define a(opcode, a_m, op, cyc) \
+                    op_##opcode: cycles += ins<Hooks::Release,true,a_m,op>() + cyc; goto done;
+                OPCODE_TABLE(a)
+                #undef a
+                done:;
+            }
+            #endif
+        }
+
+        // Catch up the rest of the system before the next instruction, as nes::step_frame does
+        m_bus->step(cycles);
+        ++executed;
+
+    } while (m_bus->m_elapsed_clocks < end);
+
+    return executed;
+}
+
+/* Block cache -------------------------------------------- */
+
+const Ricoh2A03::MicroOp* Ricoh2A03::next_op() {
+
+    // Carry on through the current block for as long as execution falls through it
+    //      and the page it was decoded from is still the one mapped
+    if (m_block != nullptr && m_cursor < m_block->ops.size()
+        && m_block->ops[m_cursor].offset == (m_reg_pc & 0xFF)
+        && m_bus->code_page(m_reg_pc >> 8) == m_block->page)
+        return &m_block->ops[m_cursor++];
+
+    // Only memory the page tables point straight at can be decoded ahead of time
+    const uint8_t* page = m_bus->code_page(m_reg_pc >> 8);
+    m_block = nullptr;
+    if (page == nullptr) return nullptr;
+
+    // Find the block starting here, decoding it the first time it is reached
+    const uint8_t* code = page + (m_reg_pc & 0xFF);
+    auto& recent = m_recent[m_reg_pc & 0x3FF];
+    if (recent.code != code) {
+        auto found = m_blocks.find(code);
+        recent.code  = code;
+        recent.block = found != m_blocks.end() ? &found->second : decode_block(page, m_reg_pc & 0xFF);
+    }
+
+    m_block = recent.block;
+    m_cursor = 0;
+    if (m_block->ops.empty()) return nullptr;
+    return &m_block->ops[m_cursor++];
+
+}
+
+Ricoh2A03::Block* Ricoh2A03::decode_block(const uint8_t* page, uint8_t offset) {
+
+    typedef struct {
+        uint8_t (Ricoh2A03::*fn)(); // Decoded instruction function pointer
+        uint8_t len;                // Base length of instruction in cycles
+        AddrModes a_m;
+        Operations op;
+    } instruction;
+
+    #define a(opcode, a_m, op, cyc) \
+        { &Ricoh2A03::ins<Hooks::Release,true,a_m,op>, cyc, a_m, op },
+    static const instruction lookup[0x100] = { OPCODE_TABLE(a) };
+    #undef a
+
+    Block& block = m_blocks[page + offset];
+    block.page = page;
+    PageBlocks& page_blocks = m_page_blocks[page];
+    page_blocks.blocks.push_back(page + offset);
+
+    // Writes to the page have to come back to the cache from now on
+    page_blocks.ram |= m_bus->protect_code(page);
+
+    for (int pc = offset; ; ) {
+
+        const instruction& i = lookup[page[pc]];
+        int operands = 0;
+        switch (i.a_m) {
+            case IMP:                                                 break;
+            case ABS: case ABX: case ABY: case IND: operands = 2;    break;
+            default:                                operands = 1;    break;
+        }
+
+        // Instructions running into the next page are left to the interpreter
+        if (pc + operands > 0xFF) break;
+
+        block.ops.push_back({ i.fn,
+            { operands > 0 ? page[pc + 1] : (uint8_t)0, operands > 1 ? page[pc + 2] : (uint8_t)0 },
+            i.len, (uint8_t)pc, page[pc] });
+        pc += 1 + operands;
+
+        // The block ends with anything that can jump, or with the page
+        bool jumps = false;
+        switch (i.op) {
+            case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+            case BRK: case JMP: case JSR: case RTI: case RTS: jumps = true; break;
+            default: break;
+        }
+        if (jumps || pc > 0xFF) break;
+    }
+
+    return &block;
+}
+
+void Ricoh2A03::code_written(const uint8_t* page) {
+
+    auto blocks = m_page_blocks.find(page);
+    if (blocks == m_page_blocks.end()) return;
+
+    // Forget about the blocks before they go, including the one being executed
+    for (auto& recent : m_recent)
+        if (recent.block != nullptr && recent.block->page == page) recent = { nullptr, nullptr };
+    if (m_block != nullptr && m_block->page == page) m_block = nullptr;
+
+    for (const uint8_t* code : blocks->second.blocks) m_blocks.erase(code);
+    m_page_blocks.erase(blocks);
+
+}
+
+void Ricoh2A03::flush_blocks() {
+
+    for (auto& recent : m_recent) recent = { nullptr, nullptr };
+    m_block = nullptr;
+    m_cursor = 0;
+
+    m_blocks.clear();
+    m_page_blocks.clear();
+
+}
+
+void Ricoh2A03::flush_ram_blocks() {
+
+    std::vector<const uint8_t*> pages;
+    for (auto& page_blocks : m_page_blocks)
+        if (page_blocks.second.ram) pages.push_back(page_blocks.first);
+    for (const uint8_t* page : pages) code_written(page);
+
+    // Execution carries on from wherever the state left off
+    m_block = nullptr;
+    m_cursor = 0;
+
+}
+
+bool Ricoh2A03::caches_code(const uint8_t* page) const {
+    return m_page_blocks.count(page) != 0;
 }
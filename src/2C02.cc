@@ -1,5 +1,6 @@
 #include <assert.h>
 #include "2C02.hh"
+#include "simd.hh"
 
 static const unsigned int g_pal_data[64] = {
     /* Physical color palette in ARGB888 format */
@@ -26,12 +27,14 @@ static const unsigned int g_pal_data[64] = {
 Ricoh2C02::Ricoh2C02() {
 
     m_cycle = 0; m_scanline = -1;
+    m_clock = 0;
     m_frameIncompete = true;
+    m_hooks = nullptr;
     m_curstate = prerender;
 
     // Create the frame buffer and clear it
-    m_framebuf = std::shared_ptr<unsigned int[]>(new unsigned int[TV_W * TV_H]);
-    for (int i = 0; i < TV_W * TV_H; i++) m_framebuf[i] = 0;
+    m_own_framebuf = std::make_unique<unsigned int[]>(frame_buf_size);
+    m_framebuf = m_own_framebuf.get();
 
     m_buf_pos = 0;
     m_io_db = 0x00;
@@ -60,16 +63,24 @@ Ricoh2C02::Ricoh2C02() {
 
 /* Get frame buffer for rendering */
 
-std::shared_ptr<unsigned int[]> Ricoh2C02::get_buf() {
+const unsigned int* Ricoh2C02::get_buf() const {
     return m_framebuf;
 };
 
+void Ricoh2C02::set_buf(unsigned int* buf) {
+    m_framebuf = buf != nullptr ? buf : m_own_framebuf.get();
+}
+
 /* Bus connections */
 
 void Ricoh2C02::connect_bus(cpu_bus* cpu_bus_ptr) {
     m_cpu_bus = cpu_bus_ptr;
 }
 
+void Ricoh2C02::attach(Instrumentation* sink) {
+    m_hooks = sink;
+}
+
 void Ricoh2C02::connect_bus(ppu_bus* ppu_bus_ptr) {
     m_ppu_bus = ppu_bus_ptr;
 }
@@ -86,13 +97,23 @@ uint8_t Ricoh2C02::RB(uint16_t addr) {
 
 /* Step the component one cycle */
 
-#define OVERFLOW(old, cur) (old > cur)
 void Ricoh2C02::step() {
 
+    // Only pay for the hooks when something is listening
+    if (m_hooks != nullptr) step_impl<Hooks::Instrumented>();
+    else step_impl<Hooks::Release>();
+
+}
+
+#define OVERFLOW(old, cur) (old > cur)
+template<typename Hooks>
+void Ricoh2C02::step_impl() {
+
     const int scanline_length = 341;
 
     // Keep track of old scanline and cycle to detect wrap arounds
     int old_cycle = m_cycle;
+    ++m_clock;
 
     // Move things along
     ++m_cycle %= scanline_length; // Increment cycle, wrap to zero after 340
@@ -230,38 +251,128 @@ void Ricoh2C02::step() {
         } break;
     }
 
+    // Mappers counting scanlines see A12 rise once per rendered line, the fetches themselves
+    //      aren't emulated so only the dot it happens on matters
+    if ((m_cycle == 260 || m_cycle == 324) && m_scanline < 240 && m_cycle == scanline_clock_cycle())
+        m_ppu_bus->clock_scanline();
+
     // Update debug info
-    #ifdef DEBUG
-    PpuContext ctx = {
-        .cycle    = m_cycle    ,
-        .scanline = m_scanline ,
-    };
-    Debugger::get().set_ppu_context(ctx);
-    // Check if a bus dump has been invoked, if so dump the ppu bus contents
-    if (Debugger::get().m_dump_ppu_bus) {
+    if constexpr (Hooks::enabled) {
+        PpuContext ctx = {
+            .cycle    = m_cycle    ,
+            .scanline = m_scanline ,
+        };
+        Hooks::ppu_step(m_hooks, ctx);
+        #ifdef DEBUG
+        // Check if a bus dump has been invoked, if so dump the ppu bus contents
+        if (Debugger::get().m_dump_ppu_bus) {
         
-        // Dump PPU bus
-        /* This data can be visualized with some python scripts I wrote in the
-                testing directory. Be wary, the code is not pretty lmao */
-        std::ofstream outfile;
-        outfile.open("testing/dumps/ppubusdump.txt", std::ios::out | std::ios::binary);
-        for (int i = 0x0000; i <= 0x3FFF; i++) outfile << RB(i);
-        outfile.close();
+            // Dump PPU bus
+            /* This data can be visualized with some python scripts I wrote in the
+                    testing directory. Be wary, the code is not pretty lmao */
+            std::ofstream outfile;
+            outfile.open("testing/dumps/ppubusdump.txt", std::ios::out | std::ios::binary);
+            for (int i = 0x0000; i <= 0x3FFF; i++) outfile << RB(i);
+            outfile.close();
         
-        // Dump SPR memory
-        outfile.open("testing/dumps/sprramdump.txt", std::ios::out | std::ios::binary);
-        for (int i = 0; i <= 0xFF; i++) outfile << m_spr_ram[i];
-        outfile.close();
+            // Dump SPR memory
+            outfile.open("testing/dumps/sprramdump.txt", std::ios::out | std::ios::binary);
+            for (int i = 0; i <= 0xFF; i++) outfile << m_spr_ram[i];
+            outfile.close();
         
-        // Set this to false so it doesn't generate upon every step
-        Debugger::get().m_dump_ppu_bus = false;
+            // Set this to false so it doesn't generate upon every step
+            Debugger::get().m_dump_ppu_bus = false;
 
+        }
+        #endif
     }
-    #endif
     
 }
 #undef OVERFLOW
 
+void Ricoh2C02::run_until(unsigned long long dot) {
+
+    // Instrumented, the hooks need to see every single dot
+    if (m_hooks != nullptr) {
+        while (m_clock < dot) step_impl<Hooks::Instrumented>();
+        return;
+    }
+
+    while (m_clock < dot) {
+        // Nothing can touch the registers before the target, so if the whole visible part
+        //      of a scanline fits the line can be rendered in one go. Register writes partway
+        //      through a line leave the rest of it to the per dot path
+        if (m_curstate == rendering && m_cycle == 0 && m_clock + TV_W <= dot && !m_per_dot)
+            render_scanline();
+        else step_impl<Hooks::Release>();
+    }
+}
+
+unsigned long long Ricoh2C02::next_event() {
+
+    const int scanline_length = 341;
+    const int frame_length = 262 * scanline_length;
+
+    // Position within the frame, the pre render scanline (-1) starts at zero
+    const int pos = (m_scanline + 1) * scanline_length + m_cycle;
+
+    // NMI is raised on the dot that moves into scanline 241, the frame completes on the
+    //      dot that wraps back around to the pre render scanline
+    const int events[] = { 242 * scanline_length, 0 };
+
+    int dots = frame_length;
+    for (int event : events) {
+        // Dots until the event next happens, strictly in the future
+        int until = ((event - pos - 1) % frame_length + frame_length) % frame_length + 1;
+        if (until < dots) dots = until;
+    }
+
+    return m_clock + dots;
+}
+
+int Ricoh2C02::scanline_clock_cycle() const {
+
+    if (!m_reg_ctrl2.show_bg && !m_reg_ctrl2.show_spries) return -1;
+
+    // 8x16 sprites pick their pattern table per sprite, games put them at $1000
+    bool sprites_hi = m_reg_ctrl1.sprite_size || m_reg_ctrl1.sprite_pattabl;
+    if (sprites_hi && !m_reg_ctrl1.bg_pattabl) return 260;
+    if (!sprites_hi && m_reg_ctrl1.bg_pattabl) return 324;
+    return -1;
+}
+
+unsigned long long Ricoh2C02::scanline_clock(int n) {
+
+    const int scanline_length = 341;
+    const long long frame_length = 262 * scanline_length;
+
+    int cycle = scanline_clock_cycle();
+    if (cycle < 0 || n <= 0) return ULLONG_MAX;
+
+    // Position within the frame, the pre render scanline (-1) starts at zero
+    const long long pos = (m_scanline + 1) * scanline_length + m_cycle;
+
+    // Scanlines -1 through 239 are clocked, 241 a frame. Count on from the first one
+    //      strictly in the future
+    long long line = (pos < cycle ? 0 : (pos - cycle) / scanline_length + 1) + (n - 1);
+    long long at = (line / 241) * frame_length + (line % 241) * scanline_length + cycle;
+
+    return m_clock + (at - pos);
+}
+
+void Ricoh2C02::position_at(unsigned long long dot, int& scanline, int& cycle) const {
+
+    const int scanline_length = 341;
+    const long long frame_length = 262 * scanline_length;
+
+    // Frames are all the same length, so just move along from the current position
+    long long pos = (m_scanline + 1) * scanline_length + m_cycle;
+    pos = ((pos + (long long)(dot - m_clock)) % frame_length + frame_length) % frame_length;
+
+    scanline = pos / scanline_length - 1;
+    cycle    = pos % scanline_length;
+}
+
 /* For sprite zero hit ------------------------------------ */
 
 bool Ricoh2C02::sprite_zero_check(int dot) {
@@ -328,9 +439,8 @@ unsigned int Ricoh2C02::fetch_bg_pixel() {
     uint16_t tileBaseAddr = (tileIndex * tileSizeBytes) + bgPatTableAddr; // In pattern memory
     uint16_t attrBaseAddr = nameTableBase + attrMemOffset + ((tile_x / 4) + ((tile_y / 4) * 8));
 
-    // Read the actual tile data bytes and extract the low bits of the color index
-    uint8_t tileDataLo = RB(tileBaseAddr + mod_y + 0), tileDataHi = RB(tileBaseAddr + mod_y + 8);
-    uint8_t colorIndex = ((tileDataLo >> (7 - mod_x)) & 1) | (((tileDataHi >> (7 - mod_x)) & 1) << 1);
+    // Look up the low bits of the color index in the decoded tile row
+    uint8_t colorIndex = m_ppu_bus->pattern_row(tileBaseAddr + mod_y, false)[mod_x];
 
     // Extract the high bits of the color index
     switch (((tile_x / 2) % 2) + (((tile_y / 2) % 2) * 2)) {
@@ -353,8 +463,90 @@ unsigned int Ricoh2C02::fetch_bg_pixel() {
     return g_pal_data[RB(colorAddress)] & alpha_mask;
 }
 
-#define IS_BG(color) \
-    (bool)(color & 0x01000000) // Abusing alpha bits to keep track of BG, not stupid if it works
+void Ricoh2C02::render_scanline() {
+
+    const uint16_t ntMemBaseAddress = 0x2000;
+    const uint16_t attrMemOffset    = 0x03C0;
+    const uint16_t iPalBaseAddress  = 0x3F00;
+
+    const int nametableRows  = 32;
+    const int tileSizePixels = 8;
+    const int tileSizeBytes  = 16;
+
+    // Same as stepping through dots 1 to 256 of the line
+    m_cycle = TV_W; m_clock += TV_W;
+    m_curstate = sprPrefetch;
+
+    if (!m_reg_ctrl2.show_bg) {
+        for (int dot = 0; dot < TV_W; dot++) {
+            m_framebuf[m_buf_pos] = 0xFF000000;
+            ++m_buf_pos %= (TV_W * TV_H);
+        }
+        return;
+    }
+
+    // Palette can't change partway through the line, so look up all 16 BG colors once. The
+    //      transparent ones get the BG alpha marker, and the extra entry at the end is the
+    //      unmarked color drawn over the left column when it is clipped
+    const uint8_t clipped = 16;
+    unsigned int palette[17];
+    for (int i = 0; i < 16; i++)
+        palette[i] = g_pal_data[RB(iPalBaseAddress + i)] & ((i & 0x3) != 0x00 ? 0xFFFFFFFF : 0xFEFFFFFF);
+    palette[clipped] = g_pal_data[RB(iPalBaseAddress)];
+
+    // Palette index of each pixel on the line, resolved to colors all at once at the end
+    uint8_t line[TV_W];
+
+    // Same scroll calculations as fetch_bg_pixel, the vertical part is fixed for the line
+    int nt_index_x = m_reg_ctrl1.nt_address & 1, nt_index_y = (m_reg_ctrl1.nt_address & 2) >> 1;
+    int scrolled_y = m_scanline + m_scroll_latch.scrollY;
+    if (scrolled_y >= TV_H) { scrolled_y %= TV_H; nt_index_y ^= 1; }
+    int tile_y = scrolled_y / tileSizePixels, mod_y = scrolled_y % tileSizePixels;
+    uint16_t bgPatTableAddr = m_reg_ctrl1.bg_pattabl ? 0x1000 : 0x0000;
+
+    const uint8_t* tileRow = nullptr; uint8_t attrBits = 0;
+    int fetched_tile = -1; // Nametable and tile x of the tile data above
+
+    for (int dot = 0; dot < TV_W; dot++) {
+
+        // When this bit is low BG within the 8 left most pixels is the BG color
+        if ((!m_reg_ctrl2.clip_bg) && (dot + 1 < 8)) {
+            line[dot] = clipped;
+            continue;
+        }
+
+        int nt_x = nt_index_x, scrolled_x = dot + m_scroll_latch.scrollX;
+        if (scrolled_x >= TV_W) { scrolled_x %= TV_W; nt_x ^= 1; }
+        int tile_x = scrolled_x / tileSizePixels, mod_x = scrolled_x % tileSizePixels;
+
+        // Only fetch once per tile, on the first pixel of it that is actually drawn
+        if (fetched_tile != nt_x * nametableRows + tile_x) {
+            fetched_tile = nt_x * nametableRows + tile_x;
+
+            uint16_t nameTableBase = ((nt_x*0x400)+(nt_index_y*0x800))+ntMemBaseAddress;
+
+            uint16_t tileIndex    = RB(nameTableBase + tile_x + (tile_y * nametableRows));
+            uint16_t tileBaseAddr = (tileIndex * tileSizeBytes) + bgPatTableAddr;
+            uint16_t attrBaseAddr = nameTableBase + attrMemOffset + ((tile_x / 4) + ((tile_y / 4) * 8));
+
+            tileRow = m_ppu_bus->pattern_row(tileBaseAddr + mod_y, false);
+
+            int shift = (((tile_x / 2) % 2) + (((tile_y / 2) % 2) * 2)) * 2;
+            attrBits = ((RB(attrBaseAddr) >> shift) & 0x03) << 2;
+        }
+
+        uint8_t colorIndex = attrBits | tileRow[mod_x];
+        if ((colorIndex & 0x3) != 0x00) /* Pixel is not BG */
+            sprite_zero_check(dot);
+
+        line[dot] = colorIndex;
+    }
+
+    // Lines always start at the beginning of a frame buffer row
+    Simd::resolve_line(&m_framebuf[m_buf_pos], line, palette, TV_W);
+    m_buf_pos = (m_buf_pos + TV_W) % (TV_W * TV_H);
+
+}
 
 void Ricoh2C02::prepare_sprite(Sprite& spr) {
 
@@ -390,19 +582,13 @@ void Ricoh2C02::prepare_sprite(Sprite& spr) {
     // Check for vertical flip, flip vertically if bit set
     if (spr.attr & 0x80) offset_y = (height - 1) - offset_y;
 
-    // Fetch sprite pattern data
+    // Fetch sprite pattern data, the two least significant bits of the color index into the global
+    //      palette for each pixel. Bit 6 of the attribute byte determines horizontal flip
     uint16_t tileBaseAddr = patternTableBase + (spr_index * tileSizeBytes); // In pattern memory
-    uint16_t tileDataLo = RB(tileBaseAddr + offset_y + 0), tileDataHi = RB(tileBaseAddr + offset_y + 8);
+    const uint8_t* tileRow = m_ppu_bus->pattern_row(tileBaseAddr + offset_y, spr.attr & 0x40);
 
-    for (int i = 0; i < tileSizePixels; i++) {
-
-        // Calculate the two least significant bits of the color index into the global palette
-        uint8_t colorIndex = (spr.attr & 0x40) ? // This specific bit determines horizontal flip
-            ((tileDataLo >> i) & 1) | (((tileDataHi >> i) & 1) << 1): // Horizontal sprite flip
-            ((tileDataLo >> (7 - i)) & 1) | (((tileDataHi >> (7 - i)) & 1) << 1);
-
-        spr.prefetch_data[i] = colorIndex;
-    }
+    for (int i = 0; i < tileSizePixels; i++)
+        spr.prefetch_data[i] = tileRow[i];
 }
 
 void Ricoh2C02::emplace_sprite(Sprite& spr) {
@@ -410,6 +596,9 @@ void Ricoh2C02::emplace_sprite(Sprite& spr) {
     const int tileSizePixels = 8;
     const uint16_t sPalBaseAddress = 0x3F10;
 
+    unsigned int row[tileSizePixels] = {};
+    uint8_t draw = 0x00;
+
     for (int i = 0; i < tileSizePixels; i++) {
 
         const uint8_t colorIndex = spr.prefetch_data[i];
@@ -418,18 +607,19 @@ void Ricoh2C02::emplace_sprite(Sprite& spr) {
         if ((!m_reg_ctrl2.clip_sprites && spr.x_pos + i < 8))
             continue; // Do not render this sprite pixel
 
-        // Determine if the pixel being rendered to is a BG pixel or not, if so render accordingly
-        //      depeinding on the sprite's render priority
-        if ((spr.attr & 0x20) && IS_BG(m_framebuf[(m_scanline * TV_W) + spr.x_pos + i]))
-            continue; // Do not render this sprite pixel
-
         // Color index zero is just ignored to my understanding. Draw nothing in this case
-        if (colorIndex != 0) m_framebuf[(m_scanline * TV_W) + spr.x_pos + i] =
-            g_pal_data[RB((colorIndex | ((spr.attr & 3) << 2)) + sPalBaseAddress)];
+        if (colorIndex != 0) {
+            row[i] = g_pal_data[RB((colorIndex | ((spr.attr & 3) << 2)) + sPalBaseAddress)];
+            draw |= 1 << i;
+        }
     }
+
+    // Sprites with their priority bit set are only drawn over transparent BG pixels, which have
+    //      bit 0x01000000 of their alpha cleared. Abusing alpha bits to keep track of BG, not
+    //      stupid if it works. The kernel checks all eight pixels at once
+    Simd::composite_sprite(&m_framebuf[(m_scanline * TV_W) + spr.x_pos], row, draw, spr.attr & 0x20);
 }
 
-#undef IS_BG
 
 
 /* MMIO functions ----------------------------------------- */
@@ -579,16 +769,62 @@ void Ricoh2C02::oam_dma_w(uint8_t value, unsigned long long cyc) {
     // Value written makes up the upper byte of the source address
     uint16_t src_addr = value << 8;
     // Initial wait state cycle to wait for write to complete
-    m_cpu_bus->step();
+    m_cpu_bus->step(1);
     // Additional cycle before transfer if on an odd CPU cycle
-    if ((cyc & 1) != 0) m_cpu_bus->step();
+    if ((cyc & 1) != 0) m_cpu_bus->step(1);
     // Begin transfer, 2 clocks per byte, one for the read and one
-    //      for the write - transfer an entire page
+    //      for the write - transfer an entire page. The PPU is caught
+    //      up before each write as sprite evaluation may be reading OAM
     for (uint16_t offset = 0; offset <= 0xFF; offset++) {
-        uint8_t data = m_cpu_bus->RB(src_addr + offset); m_cpu_bus->step();
-        m_spr_ram[offset] = data;                        m_cpu_bus->step();
+        uint8_t data = m_cpu_bus->RB(src_addr + offset); m_cpu_bus->step(1);
+        m_cpu_bus->sync_ppu();
+        m_spr_ram[offset] = data;                        m_cpu_bus->step(1);
     }
 
 }
 /* This register is write only - call open bus for read */
 
+/* Save states -------------------------------------------- */
+
+void Ricoh2C02::save(StateWriter& state) const {
+
+    state.section("PPU ");
+
+    state.put(m_curstate);
+    state.put(m_cycle); state.put(m_scanline);
+    state.put(m_clock); state.put(m_buf_pos);
+    state.put(m_frameIncompete);
+
+    // Registers and latches
+    state.put(m_io_db);
+    state.put(m_reg_ctrl1.raw); state.put(m_reg_ctrl2.raw); state.put(m_reg_status.raw);
+    state.put(m_oam_latch); state.put(m_scroll_latch); state.put(m_addr_latch);
+
+    // Sprites, including the ones prefetched for the next scanline
+    state.bytes(m_spr_ram.get(), 0x0100);
+    state.put(m_spr_buf_count);
+    for (const auto& sprite : m_spr_buf) state.put(*sprite);
+    state.put(m_sprite_0);
+
+}
+
+bool Ricoh2C02::load(StateReader& state) {
+
+    state.section("PPU ");
+
+    state.get(m_curstate);
+    state.get(m_cycle); state.get(m_scanline);
+    state.get(m_clock); state.get(m_buf_pos);
+    state.get(m_frameIncompete);
+
+    state.get(m_io_db);
+    state.get(m_reg_ctrl1.raw); state.get(m_reg_ctrl2.raw); state.get(m_reg_status.raw);
+    state.get(m_oam_latch); state.get(m_scroll_latch); state.get(m_addr_latch);
+
+    state.bytes(m_spr_ram.get(), 0x0100);
+    state.get(m_spr_buf_count);
+    for (auto& sprite : m_spr_buf) state.get(*sprite);
+    state.get(m_sprite_0);
+
+    return state.ok();
+}
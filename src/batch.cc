@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include "batch.hh"
+#include "nes.hh"
+#include "pool.hh"
+
+struct BatchJob {
+
+    // From the job file
+    std::string rom, input;
+    unsigned long long frames;
+
+    // Filled in once the job has run
+    std::string error;
+    unsigned long long instructions = 0;
+    uint64_t hash = 0;
+    double seconds = 0;
+
+};
+
+// Lines of a job or input file with comments stripped, skipping the ones left blank
+static bool read_lines(const std::string& path, std::vector<std::string>& lines) {
+
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+
+    for (std::string line; std::getline(file, line);) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") != std::string::npos) lines.push_back(line);
+    }
+    return true;
+}
+
+static bool read_input(const std::string& path, std::vector<InputEvent>& input) {
+
+    std::vector<std::string> lines;
+    if (!read_lines(path, lines)) return false;
+
+    for (const std::string& line : lines) {
+        std::istringstream fields(line);
+        unsigned long long frame; unsigned buttons;
+        if (!(fields >> frame >> std::hex >> buttons) || buttons > 0xFF) return false;
+        input.push_back({ frame, (uint8_t)buttons });
+    }
+
+    // Played back in order of the frames they happen on
+    std::stable_sort(input.begin(), input.end(), [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+    return true;
+}
+
+static void run_job(BatchJob& job) {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    timing::time_point start = timing::now();
+
+    std::vector<InputEvent> input;
+    if (!job.input.empty() && !read_input(job.input, input)) {
+        job.error = "could not read input " + job.input;
+        return;
+    }
+
+    // Every job gets a machine of its own, nothing is shared between them
+    std::unique_ptr<nes> machine = std::make_unique<nes>();
+    if (!machine->load_cart(job.rom)) {
+        job.error = "could not load rom";
+        return;
+    }
+
+    job.hash = machine->run_recorded(job.frames, input);
+    job.instructions = machine->instructions();
+    job.seconds = duration<double>(timing::now() - start).count();
+
+}
+
+bool run_batch(const std::string& job_path, unsigned threads) {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    std::vector<std::string> lines;
+    if (!read_lines(job_path, lines)) {
+        std::cout << "Could not read job file: " << job_path << std::endl;
+        return false;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const std::string& line : lines) {
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.rom >> job.frames)) {
+            std::cout << "Malformed job: " << line << std::endl;
+            return false;
+        }
+        fields >> job.input;
+        jobs.push_back(job);
+    }
+
+    #ifdef DEBUG
+    // There is just the one debugger, and it's attached to every machine
+    threads = 1;
+    #endif
+
+    WorkStealingPool pool(threads);
+    std::vector<WorkStealingPool::Task> tasks;
+    for (BatchJob& job : jobs) tasks.push_back([&job] { run_job(job); });
+
+    timing::time_point start = timing::now();
+    pool.run(tasks);
+    double seconds = duration<double>(timing::now() - start).count();
+
+    // Reported in the order of the job file, whatever order they finished in
+    unsigned long long frames = 0, failed = 0;
+    double busy = 0;
+    for (size_t index = 0; index < jobs.size(); index++) {
+
+        const BatchJob& job = jobs[index];
+        std::cout << std::setw(6) << index << "  " << std::left << std::setw(32) << job.rom << std::right;
+
+        if (!job.error.empty()) {
+            std::cout << "  FAILED: " << job.error << std::endl;
+            failed++;
+            continue;
+        }
+
+        frames += job.frames;
+        busy += job.seconds;
+        std::cout << std::setw(8) << job.frames << " frames  " << std::setw(12) << job.instructions << " instructions  "
+            << std::hex << std::setw(16) << std::setfill('0') << job.hash << std::dec << std::setfill(' ')
+            << std::fixed << std::setprecision(1) << std::setw(10) << job.frames / job.seconds << " frames/s" << std::endl;
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Jobs:            " << jobs.size() << " (" << failed << " failed)" << std::endl;
+    std::cout << "Threads:         " << pool.threads() << " (" << pool.stolen() << " jobs stolen)" << std::endl;
+    std::cout << "Wall time:       " << seconds << " s" << std::endl;
+    std::cout << "Jobs/s:          " << jobs.size() / seconds << std::endl;
+    std::cout << "Frames/s:        " << frames / seconds << std::endl;
+    std::cout << "Thread use:      " << busy / (seconds * pool.threads()) * 100.0 << " %" << std::endl;
+
+    return true;
+}
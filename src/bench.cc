@@ -0,0 +1,659 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include "nes.hh"
+
+/* Micro benchmarks ------------------------------------------------------------------
+
+   These drive the components of the loaded cartridge directly rather than emulating
+   whole frames, so they isolate the cost of one particular path. They are run with
+   --bench <name> after the rom path, see nes::benchmark for the list of names.
+
+   ----------------------------------------------------------------------------------- */
+
+// Time a function over a number of iterations and return nanoseconds per iteration
+template<typename Fn>
+static double time_ns(unsigned long long iterations, Fn fn) {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    timing::time_point start = timing::now();
+    for (unsigned long long i = 0; i < iterations; i++) fn(i);
+    return duration<double, std::nano>(timing::now() - start).count() / iterations;
+
+}
+
+static void report(const std::string& what, double ns_per_access) {
+    std::cout << std::fixed << std::setprecision(2)
+        << "  " << std::left << std::setw(36) << what << std::right
+        << std::setw(8) << ns_per_access << " ns/access  "
+        << std::setw(8) << 1000.0 / ns_per_access << " M accesses/s" << std::endl;
+}
+
+bool nes::benchmark(const std::string& name) {
+
+    m_cpu_bus.rst();
+
+    if (name == "io") bench_io();
+    else if (name == "hooks") bench_hooks();
+    else if (name == "trace") bench_trace();
+    else if (name == "gamegenie") bench_gamegenie();
+    else if (name == "dispatch") bench_dispatch();
+    else if (name == "state") bench_state();
+    else if (name == "rewind") bench_rewind();
+    else if (name == "runahead") bench_run_ahead();
+    else if (name == "pacing") bench_pacing();
+    else if (name == "load") bench_load();
+    else if (name == "romdb") bench_romdb();
+    else if (name == "mapper") bench_mapper();
+    else if (name == "banks") bench_banks();
+    else {
+        std::cout << "Unknown benchmark: " << name << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// IO register traffic through the cpu bus, the kind of accesses IO heavy roms spend
+//      most of their time on: polling $2002, bursts of $2007 writes and joypad reads
+void nes::bench_io() {
+
+    const unsigned long long iterations = 20000000;
+    volatile uint8_t sink = 0;
+
+    std::cout << "IO register dispatch (" << iterations << " accesses each)" << std::endl;
+
+    report("$2002 status polling", time_ns(iterations, [&](unsigned long long) {
+        sink = sink + m_cpu_bus.RB(0x2002);
+    }));
+    report("$3FFA status polling (mirrored)", time_ns(iterations, [&](unsigned long long) {
+        sink = sink + m_cpu_bus.RB(0x3FFA);
+    }));
+
+    // Point the PPU at the first name table before bursting, bursts wrap every 1 KiB
+    report("$2007 name table write burst", time_ns(iterations, [&](unsigned long long i) {
+        if ((i & 0x3FF) == 0) { m_cpu_bus.WB(0x2006, 0x20); m_cpu_bus.WB(0x2006, 0x00); }
+        m_cpu_bus.WB(0x2007, (uint8_t)i);
+    }));
+    report("$4016 joypad reads", time_ns(iterations, [&](unsigned long long) {
+        sink = sink + m_cpu_bus.RB(0x4016);
+    }));
+    report("$4018 unmapped register reads", time_ns(iterations, [&](unsigned long long) {
+        sink = sink + m_cpu_bus.RB(0x4018);
+    }));
+
+    // The lookup and call alone, through a dispatch table as the bus does and through a hash
+    //      map keyed by the reduced address as it used to (operator[] and all, which adds an
+    //      entry for every unmapped register read), for the difference the tables make
+    using namespace AddressMirrors::CpuBus;
+    using Read = uint8_t(*)(nes&);
+
+    std::unordered_map<uint16_t, Read> hashed;
+    Read table[io_table_size] = {};
+    hashed[0x2002] = table[io_index(0x2002)] = [](nes& n) { return n.m_ppu.status_r(); };
+    hashed[0x4016] = table[io_index(0x4016)] = [](nes& n) { return n.m_ctrl1.r_joypad(); };
+
+    std::cout << "Register lookup alone, table against hash map" << std::endl;
+
+    volatile uint16_t addr;
+    for (uint16_t polled : { 0x2002, 0x3FFA, 0x4016, 0x4018 }) {
+
+        addr = polled;
+        std::ostringstream what;
+        what << "$" << std::hex << std::uppercase << polled;
+
+        report(what.str() + " table", time_ns(iterations, [&](unsigned long long) {
+            Read read = table[io_index(mirror_io(addr))];
+            if (read != nullptr) sink = sink + read(*this);
+        }));
+        report(what.str() + " hash map (before)", time_ns(iterations, [&](unsigned long long) {
+            Read read = hashed[mirror_io(addr)];
+            if (read != nullptr) sink = sink + read(*this);
+        }));
+
+    }
+
+}
+
+// Whole frames with and without an instrumentation sink attached to the CPU and PPU. The
+//      sink ignores everything, so this is purely the cost of the instrumented code paths
+void nes::bench_hooks() {
+
+    const unsigned long long frames = 300;
+    Instrumentation ignore_everything;
+
+    // Whatever was attached (the debugger) goes back once done
+    Instrumentation* cpu_sink = m_cpu.attached();
+    Instrumentation* ppu_sink = m_ppu.attached();
+
+    std::cout << "Hook overhead (" << frames << " frames each)" << std::endl;
+
+    for (Instrumentation* sink : { (Instrumentation*)nullptr, &ignore_everything }) {
+
+        m_cpu.attach(sink); m_ppu.attach(sink);
+        m_cpu_bus.rst();
+
+        double ns = time_ns(frames, [&](unsigned long long) { step_frame(); });
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << std::left << std::setw(36) << (sink ? "Instrumented, empty sink" : "Release, nothing attached")
+            << std::right << std::setw(8) << ns / 1000000.0 << " ms/frame" << std::endl;
+    }
+
+    m_cpu.attach(cpu_sink); m_ppu.attach(ppu_sink);
+
+}
+
+// Whole frames untraced, then traced the way --trace does it and through the full instrumentation
+//      hooks instead, which takes the CPU off the block cache and dispatch engines. Once with a sink
+//      that ignores everything, the cost of each path alone, and once writing a trace file next to
+//      the rom, removed afterwards. The writer thread competes for a core of its own
+void nes::bench_trace() {
+
+    const unsigned long long frames = 300;
+    Instrumentation ignore_everything;
+
+    if (m_rom_path.empty()) return;
+    std::string path = m_rom_path + ".bench.trace";
+
+    // Whatever was tracing or attached goes back once done
+    Instrumentation* cpu_sink = m_cpu.attached();
+    Instrumentation* tracer = m_cpu.tracer();
+
+    std::cout << "Trace overhead (" << frames << " frames each)" << std::endl;
+
+    struct { const char* name; bool traced; bool hooks; bool file; } ways[] = {
+        { "Untraced",                       false, false, false },
+        { "Traced, empty sink",             true,  false, false },
+        { "Hooks, empty sink",              true,  true,  false },
+        { "Traced to a file",               true,  false, true },
+        { "Hooks, traced to a file",        true,  true,  true },
+    };
+
+    for (auto& way : ways) {
+
+        Instrumentation* sink = way.traced ? &ignore_everything : nullptr;
+        std::unique_ptr<TraceWriter> writer;
+        if (way.file) {
+            writer = std::make_unique<TraceWriter>(path, &m_cpu_bus, &m_ppu);
+            if (!writer->is_open()) break;
+            sink = writer.get();
+        }
+
+        m_cpu.trace(way.hooks ? nullptr : sink);
+        m_cpu.attach(way.hooks ? sink : nullptr);
+        m_cpu_bus.rst();
+
+        double ns = time_ns(frames, [&](unsigned long long) { step_frame(); });
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << std::left << std::setw(36) << way.name
+            << std::right << std::setw(8) << ns / 1000000.0 << " ms/frame";
+        if (writer) std::cout << "  " << writer->records() << " records, " << writer->stalls() << " waits";
+        std::cout << std::endl;
+
+        m_cpu.trace(nullptr); m_cpu.attach(nullptr);
+    }
+
+    std::remove(path.c_str());
+    m_cpu.attach(cpu_sink); m_cpu.trace(tracer);
+
+}
+
+// Encode a Game Genie code, the inverse of GameGenie::decode_6_char_code and decode_8_char_code
+static std::string encode_game_genie(uint16_t addr, uint8_t data, int compare = -1) {
+
+    const char* letters = "APZLGITYEOXUKSVN";
+    int digits[8];
+
+    digits[0] = (data & 7) | ((data >> 4) & 8);
+    digits[1] = ((data >> 4) & 7) | ((addr >> 4) & 8);
+    digits[2] = ((addr >> 4) & 7) | (compare >= 0 ? 8 : 0);
+    digits[3] = ((addr >> 12) & 7) | (addr & 8);
+    digits[4] = (addr & 7) | ((addr >> 8) & 8);
+    if (compare < 0) digits[5] = ((addr >> 8) & 7) | (data & 8);
+    else {
+        digits[5] = ((addr >> 8) & 7) | (compare & 8);
+        digits[6] = (compare & 7) | ((compare >> 4) & 8);
+        digits[7] = ((compare >> 4) & 7) | (data & 8);
+    }
+
+    std::string code;
+    for (int i = 0; i < (compare < 0 ? 6 : 8); i++) code += letters[digits[i]];
+    return code;
+}
+
+// CPU bus reads with 0, 3 and 50 Game Genie codes active, half of them 8 character compare
+//      codes. Reads outside of patched pages should cost the same no matter how many there are
+void nes::bench_gamegenie() {
+
+    const unsigned long long iterations = 20000000;
+    volatile uint8_t sink = 0;
+    int active = 0;
+
+    for (int codes : { 0, 3, 50 }) {
+
+        // Spread the codes over PRG ROM, in as many different pages as possible
+        for (; active < codes; active++) {
+            uint16_t addr = 0x8000 + ((active * 0x0A3D) & 0x7FFF);
+            add_cheat_code(active & 1 ? encode_game_genie(addr, 0xEA, 0x00) : encode_game_genie(addr, 0xEA));
+        }
+
+        std::cout << "Game Genie, " << codes << " codes active (" << iterations << " accesses each)" << std::endl;
+
+        report("RAM reads", time_ns(iterations, [&](unsigned long long i) {
+            sink = sink + m_cpu_bus.RB(i & 0x07FF);
+        }));
+        report("PRG ROM sweep $8000 - $FFFF", time_ns(iterations, [&](unsigned long long i) {
+            sink = sink + m_cpu_bus.RB(0x8000 | (i & 0x7FFF));
+        }));
+        report("PRG ROM page $80, patched once active", time_ns(iterations, [&](unsigned long long i) {
+            sink = sink + m_cpu_bus.RB(0x8000 | (i & 0xFF));
+        }));
+    }
+
+}
+
+// Whole frames with each of the CPU's dispatch engines, plus the one instruction per call
+//      loop step_frame used before Ricoh2A03::run. The PPU's share of a frame is the same
+//      for all of them, so the difference is down to getting from one instruction to the next
+void nes::bench_dispatch() {
+
+    const unsigned long long frames = 600;
+
+    std::cout << "CPU dispatch (" << frames << " frames each)" << std::endl;
+
+    struct { const char* name; int engine; } engines[] = {
+        { "step, one instruction per call", -1 },
+        { "run, indirect call",             Ricoh2A03::CALL },
+        { "run, switch",                    Ricoh2A03::SWITCH },
+        { "run, computed goto",             Ricoh2A03::GOTO },
+    };
+
+    for (auto& engine : engines) {
+
+        if (engine.engine == Ricoh2A03::GOTO && !Ricoh2A03::has_computed_goto) continue;
+        if (engine.engine >= 0) m_cpu.dispatch((Ricoh2A03::Dispatch)engine.engine);
+        m_cpu_bus.rst();
+
+        unsigned long long instructions = m_instructions;
+        double ns = time_ns(frames, [&](unsigned long long) {
+            if (engine.engine >= 0) { step_frame(); return; }
+            while (m_ppu.m_frameIncompete) {
+                m_cpu_bus.step(m_cpu.step());
+                ++m_instructions;
+            }
+            m_ppu.m_frameIncompete = true;
+        });
+        instructions = m_instructions - instructions;
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << std::left << std::setw(36) << engine.name << std::right
+            << std::setw(8) << ns / 1000000.0 << " ms/frame  " << std::setprecision(2)
+            << std::setw(8) << instructions / (ns * frames) * 1000.0 << " M instructions/s" << std::endl;
+    }
+
+    m_cpu.dispatch(Ricoh2A03::has_computed_goto ? Ricoh2A03::GOTO : Ricoh2A03::SWITCH);
+
+}
+
+// Saving and loading whole machine states a couple of seconds into the rom. First a round trip:
+//      the frames and the state following a load have to match the ones that followed the save
+void nes::bench_state() {
+
+    const unsigned long long iterations = 20000;
+    std::vector<uint8_t> state, scratch, continued, reloaded;
+
+    // FNV-1a over the next 60 frames
+    auto hash_frames = [&]() {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int frame = 0; frame < 60; frame++) {
+            step_frame();
+            const unsigned int* pixels = m_ppu.get_buf();
+            for (int pixel = 0; pixel < TV_W * TV_H; pixel++)
+                hash = (hash ^ pixels[pixel]) * 0x100000001B3ULL;
+        }
+        return hash;
+    };
+
+    for (int frame = 0; frame < 120; frame++) step_frame();
+    save_state(state);
+
+    uint64_t hash_continued = hash_frames();
+    save_state(continued);
+    bool loaded = load_state(state);
+    uint64_t hash_reloaded = hash_frames();
+    save_state(reloaded);
+
+    std::cout << "Save states (" << state.size() << " bytes, " << iterations << " each)" << std::endl;
+    std::cout << "  " << std::left << std::setw(36) << "Round trip" << std::right
+        << (loaded && hash_continued == hash_reloaded && continued == reloaded ? "identical" : "DIFFERENT") << std::endl;
+
+    for (bool saving : { true, false }) {
+        double ns = time_ns(iterations, [&](unsigned long long) {
+            if (saving) save_state(scratch);
+            else load_state(state);
+        });
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << std::left << std::setw(36) << (saving ? "save_state" : "load_state") << std::right
+            << std::setw(8) << ns / 1000.0 << " us" << std::endl;
+    }
+
+}
+
+// A minute of frames captured into the rewind buffer, then played all the way back. Every
+//      state that comes back out has to be the one that went in for that frame
+void nes::bench_rewind() {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    const unsigned long long frames = 3600;
+    Rewind rewind(20 << 20);
+    std::vector<uint8_t> state;
+    std::vector<uint64_t> hashes;
+
+    // FNV-1a over a whole state
+    auto hash_state = [&]() {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (uint8_t byte : state) hash = (hash ^ byte) * 0x100000001B3ULL;
+        return hash;
+    };
+
+    double emulate_ns = 0, capture_ns = 0;
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        timing::time_point start = timing::now();
+        step_frame();
+        timing::time_point emulated = timing::now();
+        save_state(state);
+        rewind.push(state);
+        timing::time_point captured = timing::now();
+        emulate_ns += duration<double, std::nano>(emulated - start).count();
+        capture_ns += duration<double, std::nano>(captured - emulated).count();
+        hashes.push_back(hash_state());
+    }
+
+    size_t kept = rewind.frames(), bytes = rewind.bytes();
+    bool identical = true;
+    double pop_ns = 0;
+    for (size_t frame = hashes.size(); frame-- > 0 && rewind.frames(); ) {
+        timing::time_point start = timing::now();
+        rewind.pop(state);
+        pop_ns += duration<double, std::nano>(timing::now() - start).count();
+        identical = identical && hash_state() == hashes[frame];
+    }
+
+    std::cout << "Rewind (" << frames << " frames, " << state.size() << " byte states)" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+        << "  " << std::left << std::setw(36) << "Frames kept" << std::right
+        << std::setw(8) << kept << " in " << bytes / 1048576.0 << " MiB" << std::endl
+        << "  " << std::left << std::setw(36) << "Played back" << std::right
+        << (identical ? "identical" : "DIFFERENT") << std::endl
+        << "  " << std::left << std::setw(36) << "Capture" << std::right
+        << std::setw(8) << capture_ns / frames / 1000.0 << " us/frame  "
+        << std::setw(8) << capture_ns / emulate_ns * 100.0 << " % of emulation" << std::endl
+        << "  " << std::left << std::setw(36) << "Step back" << std::right
+        << std::setw(8) << pop_ns / kept / 1000.0 << " us/frame" << std::endl;
+
+}
+
+// Frames shown with each amount of run ahead, and what the snapshot and restore around the
+//      frames ahead add to each of them. All of it has to fit in the 16.67 ms of a real frame
+void nes::bench_run_ahead() {
+
+    const unsigned long long frames = 300;
+    const double frame_ms = 1000.0 / 60.0;
+
+    std::cout << "Run ahead (" << frames << " frames shown each)" << std::endl;
+
+    for (unsigned ahead = 0; ahead <= 4; ahead++) {
+
+        run_ahead(ahead);
+        m_cpu_bus.rst();
+        m_snapshot_ns = m_ahead_ns = m_restore_ns = 0;
+
+        double ns = time_ns(frames, [&](unsigned long long) { advance_frame(); restore_ahead(); });
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << ahead << " frames ahead" << std::setw(12) << ns / 1000000.0 << " ms/frame  "
+            << std::setprecision(1) << std::setw(5) << ns / 10000.0 / frame_ms << " % of a frame  "
+            << std::setprecision(2) << "snapshot " << m_snapshot_ns / 1000.0 / frames
+            << " us, restore " << m_restore_ns / 1000.0 / frames << " us" << std::endl;
+    }
+
+    run_ahead(0);
+
+}
+
+// Whole frames paced to 60 per second, first by spinning until the frame is up the way nes::run
+//      used to and then with the frame pacer. The CPU time used is what matters, the spinning
+//      keeps a core busy no matter how little of the frame emulation takes
+void nes::bench_pacing() {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    const unsigned long long frames = 120;
+    const nanoseconds frame_ns(16666667);
+
+    std::cout << "Frame pacing (" << frames << " frames each)" << std::endl;
+
+    for (bool spinning : { true, false }) {
+
+        FramePacer pacer(frame_ns);
+        timing::time_point last = timing::now();
+        double worst_ms = 0;
+
+        std::clock_t cpu = std::clock();
+        double ns = time_ns(frames, [&](unsigned long long) {
+            step_frame();
+            if (spinning) while (timing::now() - last < frame_ns) ;
+            else pacer.wait();
+            worst_ms = std::max(worst_ms, duration<double, std::milli>(timing::now() - last).count());
+            last = timing::now();
+        });
+        double cpu_ns = (std::clock() - cpu) * 1e9 / CLOCKS_PER_SEC / frames;
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "  " << std::left << std::setw(24) << (spinning ? "Spinning" : "Frame pacer") << std::right
+            << std::setw(8) << ns / 1000000.0 << " ms/frame  " << std::setw(8) << worst_ms << " ms worst  "
+            << std::setprecision(1) << std::setw(5) << cpu_ns / ns * 100.0 << " % CPU";
+        if (!spinning)
+            std::cout << std::setprecision(3) << "  (" << pacer.spun().count() / 1000.0 / frames
+                << " us spun per frame, " << pacer.missed() << " missed)";
+        std::cout << std::endl;
+    }
+
+}
+
+// Resident memory of the whole process in bytes, 0 where there's no telling
+static size_t resident_bytes() {
+    #ifdef __linux__
+    size_t pages = 0, resident = 0;
+    std::ifstream("/proc/self/statm") >> pages >> resident;
+    return resident * 4096;
+    #else
+    return 0;
+    #endif
+}
+
+// Loading the rom into fresh cartridges, mapping the file and the old way of reading all of it
+//      into memory. Then what every extra cartridge of the same rom adds to resident memory once
+//      all of its rom has been read, with the rom mapped and with copies of it
+void nes::bench_load() {
+
+    const unsigned long long iterations = 2000;
+    const int instances = 64;
+
+    if (m_rom_path.empty()) return;
+    const RomImage& image = m_cart.rom_image();
+    std::vector<uint8_t> rom(image.data(), image.data() + image.size());
+
+    std::cout << "Rom loading (" << rom.size() << " byte rom, " << iterations << " loads each)" << std::endl;
+
+    for (int way = 0; way < 3; way++) {
+        double ns = time_ns(iterations, [&](unsigned long long) {
+            Cart cart;
+            if (way == 0) cart.load_rom(m_rom_path);
+            else if (way == 1) cart.load_rom(rom.data(), rom.size());
+            else {
+                std::ifstream file(m_rom_path, std::ios::binary);
+                std::vector<uint8_t> read((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                cart.load_rom(read.data(), read.size());
+            }
+        });
+        const char* names[] = { "Mapped, shared with the open rom", "Copied from memory", "Read from the file, then copied" };
+        std::cout << std::fixed << std::setprecision(2)
+            << "  " << std::left << std::setw(36) << names[way] << std::right
+            << std::setw(8) << ns / 1000.0 << " us/load" << std::endl;
+    }
+
+    if (resident_bytes() == 0) return;
+    std::cout << "Resident memory (" << instances << " more cartridges each)" << std::endl;
+
+    for (bool mapped : { true, false }) {
+
+        size_t before = resident_bytes();
+        std::vector<std::unique_ptr<Cart>> carts;
+        volatile uint8_t sink = 0;
+
+        for (int instance = 0; instance < instances; instance++) {
+            carts.push_back(std::make_unique<Cart>());
+            if (mapped) carts.back()->load_rom(m_rom_path);
+            else carts.back()->load_rom(rom.data(), rom.size());
+
+            // Read every byte, as if the whole rom got used
+            const RomImage& loaded = carts.back()->rom_image();
+            for (size_t i = 0; i < loaded.size(); i += 64) sink = sink + loaded.data()[i];
+        }
+
+        double per_instance = (double)(resident_bytes() - before) / instances;
+        std::cout << std::fixed << std::setprecision(1)
+            << "  " << std::left << std::setw(36) << (mapped ? "Mapped" : "Copied") << std::right
+            << std::setw(8) << per_instance / 1024.0 << " KiB per cartridge" << std::endl;
+    }
+
+}
+
+// Hashing the rom for the rom database, a bit at a time as the CRC is defined against the
+//      slicing by 8 version used for lookups. Then the lookup itself
+void nes::bench_romdb() {
+
+    const RomImage& image = m_cart.rom_image();
+    const uint8_t* data = image.data() + 16;
+    size_t size = image.size() - 16;
+
+    auto bitwise = [](const uint8_t* data, size_t size) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        return ~crc;
+    };
+
+    uint32_t expected = bitwise(data, size), crc = RomDb::crc32(data, size);
+    std::cout << "Rom CRC32 (" << size << " bytes): " << std::hex << std::setw(8) << std::setfill('0')
+        << crc << std::dec << std::setfill(' ') << (crc == expected ? "" : ", WRONG") << std::endl;
+
+    volatile uint32_t sink = 0;
+    double bitwise_ns = time_ns(20, [&](unsigned long long) { sink = bitwise(data, size); });
+    double sliced_ns = time_ns(200, [&](unsigned long long) { sink = RomDb::crc32(data, size); });
+
+    for (double ns : { bitwise_ns, sliced_ns })
+        std::cout << std::fixed << std::setprecision(2)
+            << "  " << std::left << std::setw(36) << (ns == bitwise_ns ? "Bit at a time" : "Sliced by 8") << std::right
+            << std::setw(8) << ns / 1000.0 << " us/rom  "
+            << std::setw(8) << size * 1000.0 / ns << " MB/s" << std::endl;
+
+    // Lookups of roms that are and aren't in the database cost the same
+    CartInfo info;
+    std::cout << "Rom database (" << RomDb::size() << " roms), this rom is "
+        << (RomDb::find(crc, info) ? "in it" : "not in it") << std::endl;
+    report("Lookup", time_ns(1000000, [&](unsigned long long i) {
+        sink = RomDb::find(crc + (uint32_t)(i & 1), info);
+    }));
+
+}
+
+// Cartridge accesses the way the buses make them, through the mapper's virtual interface as
+//      they used to and through the cartridge's dispatch on the concrete mapper type. The
+//      pointer is read back from a volatile so the compiler can't devirtualize it either
+void nes::bench_mapper() {
+
+    const unsigned long long iterations = 20000000;
+
+    Mapper* volatile mapper = m_cart.virtual_mapper();
+    volatile uint8_t sink = 0;
+    volatile int mode = 0;
+
+    std::cout << "Mapper dispatch (" << iterations << " accesses each)" << std::endl;
+
+    report("CPU reads, virtual", time_ns(iterations, [&](unsigned long long i) {
+        sink = mapper->cpu_RB(0x8000 | (i & 0x7FFF));
+    }));
+    report("CPU reads, direct", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_cart.cpu_RB(0x8000 | (i & 0x7FFF));
+    }));
+
+    report("PPU reads, virtual", time_ns(iterations, [&](unsigned long long i) {
+        sink = mapper->ppu_RB(i & 0x1FFF);
+    }));
+    report("PPU reads, direct", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_cart.ppu_RB(i & 0x1FFF);
+    }));
+
+    report("Mirroring, virtual", time_ns(iterations, [&](unsigned long long) {
+        mode = mapper->nt_mirror();
+    }));
+    report("Mirroring, direct", time_ns(iterations, [&](unsigned long long) {
+        mode = m_cart.nt_mirror();
+    }));
+
+    // Whole name table reads through the PPU bus
+    report("Name table reads (PPU bus)", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_ppu_bus.RB(0x2000 | (i & 0xFFF));
+    }));
+
+}
+
+// Reads of banked cartridge memory, which mappers point straight at from bases worked out on
+//      each bank switch, and the bank switches themselves. A switch is the whole register
+//      write, five serial writes on MMC1, of a bank that doesn't exist on most carts so
+//      it wraps around
+void nes::bench_banks() {
+
+    const unsigned long long iterations = 20000000;
+    volatile uint8_t sink = 0;
+
+    std::cout << "Banked reads (" << iterations << " accesses each)" << std::endl;
+
+    report("PRG ROM reads", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_cart.cpu_RB(0x8000 | (i & 0x7FFF));
+    }));
+    report("PRG RAM reads", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_cart.cpu_RB(0x6000 | (i & 0x1FFF));
+    }));
+    report("CHR reads", time_ns(iterations, [&](unsigned long long i) {
+        sink = m_cart.ppu_RB(i & 0x1FFF);
+    }));
+    report("Pattern table rows", time_ns(iterations, [&](unsigned long long i) {
+        const uint8_t* row = m_cart.chr_row((i << 4) & 0x1FF7, false);
+        sink = row ? row[i & 0x7] : 0;
+    }));
+
+    report("Bank switches", time_ns(iterations / 100, [&](unsigned long long i) {
+        if (m_cart.info().mapper == 1)
+            for (int bit = 0; bit < 5; bit++) m_cart.cpu_WB(0xE000, (uint8_t)((i & 0x7) >> bit));
+        else m_cart.cpu_WB(0x8000 | (i & 0x1), (uint8_t)i);
+    }));
+
+    m_cpu_bus.rst();
+
+}
@@ -1,142 +1,343 @@
 #include "cart/cart.hh"
+#include "memory.hh"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <fstream>
+
+Cart::Cart() {
+
+    // Nothing mapped into the pattern tables until a rom is loaded
+    std::fill(m_chr_map, m_chr_map + 8, -1);
+
+}
+
+bool Cart::supports_mapper(int mapper_number) {
+
+    switch (mapper_number) {
+        case 0: case 1: case 2: case 4: return true;
+    }
+
+    return false;
+}
 
 // Initialize the mapper pointer with a pointer to the cartridges respective mapper. Will
 //      be called within load_rom
 bool Cart::init_mapper(int mapper_number) {
 
+    m_mapper.emplace<std::monostate>();
+    m_mapper_mirroring = mapper_number == 1 || mapper_number == 4;
     switch (mapper_number) {
 
         // Factory design pattern - balls are sore yah
-        case 0: m_mapper = std::make_unique<Mapper_000>(
+        case 0: m_mapper.emplace<Mapper_000>(
             this,
-            m_cart_header.size_prg_rom * 0x4000,
-            m_cart_header.size_chr_rom * 0x2000,
-            m_cart_header.size_prg_ram * 0x2000); 
+            m_info.prg_rom,
+            m_info.chr_rom,
+            m_info.prg_ram + m_info.prg_nvram); 
             return true;
-        case 1: m_mapper = std::make_unique<Mapper_001>(
+        case 1: m_mapper.emplace<Mapper_001>(
             this,
-            m_cart_header.size_prg_rom * 0x4000,
-            m_cart_header.size_chr_rom * 0x2000,
-            m_cart_header.size_prg_ram * 0x2000);
+            m_info.prg_rom,
+            m_chr_rom_size,
+            m_info.prg_ram + m_info.prg_nvram);
             return true;
-        case 2: m_mapper = std::make_unique<Mapper_002>(
+        case 2: m_mapper.emplace<Mapper_002>(
             this,
-            m_cart_header.size_prg_rom,
-            m_cart_header.size_chr_rom,
+            m_info.prg_rom / 0x4000,
+            m_info.chr_rom / 0x2000,
             m_cart_header.mapper_0 & 0x3);
 
-            // When size_chr_rom is zero, chr_rom is actually replaced with RAM so the vector
-            //     will need to be resized accordingly.
-            if (m_cart_header.size_chr_rom == 0)
-                m_chr_rom.resize(0x2000);
-
+            return true;
+        case 4: m_mapper.emplace<Mapper_004>(
+            this,
+            m_info.prg_rom,
+            m_chr_rom_size,
+            m_info.vertical);
             return true;
     }
     
     return false;
 }
 
-// Initialize the memory blocks and fill them with the respective memory from the ROM file
 bool Cart::load_rom(const std::string& rom_path) {
 
-    // Open rom and read the cartridge header
-    std::ifstream rom_file = std::ifstream(rom_path, std::ios::binary);
-    if (rom_file.is_open()) {
-        rom_file.read((char*)&m_cart_header, sizeof(CartHeader));
-    }
-    else {
+    std::shared_ptr<const RomImage> image = RomImage::open(rom_path);
+    if (!image) {
         std::cout << "ROM file could not be opened" << std::endl;
         return false;
     }
+    return load_rom(image);
 
-    // Ignore the 512 byte trainer, if the file contains it
-    if ((m_cart_header.mapper_0 & 0x4) != 0x0) 
-        rom_file.seekg(512, rom_file.cur);
+}
 
-    // Assume one page of RAM when this is zero, docs say so 
-    if (m_cart_header.size_prg_ram == 0) ++m_cart_header.size_prg_ram;
+bool Cart::load_rom(const uint8_t* rom, size_t size) {
+    return load_rom(RomImage::copy(rom, size));
+}
 
-    // Resize the vectors based on the specifications in the header
-    m_prg_rom.resize(0x4000 * (int)m_cart_header.size_prg_rom * sizeof(uint8_t));
-    m_chr_rom.resize(0x2000 * (int)m_cart_header.size_chr_rom * sizeof(uint8_t));
-    m_prg_ram.resize(0x2000 * (int)m_cart_header.size_prg_ram * sizeof(uint8_t));
+// Point the roms into the image and allocate the RAMs based on the cartridge header, or the
+//      rom database's entry for the rom if it has one
+bool Cart::load_rom(std::shared_ptr<const RomImage> image) {
 
-    // Copy the rom to the memory blocks
-    rom_file.read((char*)m_prg_rom.data(), m_prg_rom.size() * sizeof(uint8_t));
-    rom_file.read((char*)m_chr_rom.data(), m_chr_rom.size() * sizeof(uint8_t));
+    // Read the cartridge header. Everything is worked out on the side and only replaces the
+    //      cartridge's once the rom turns out to be usable
+    CartHeader header;
+    CartInfo info;
+    if (image->size() < sizeof(CartHeader)) {
+        std::cout << "Not an iNES rom" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, image->data(), sizeof(CartHeader));
+    if (!info.parse(header.constants)) {
+        std::cout << "Not an iNES rom" << std::endl;
+        return false;
+    }
 
-    // Initialize the mapper pointer
-    uint8_t mapper_number = (m_cart_header.mapper_1 & 0xF0) | ((m_cart_header.mapper_0 & 0xF0) >> 4);
-    if (!init_mapper(mapper_number)) {
-        std::cout << "Unimplemented mapper type: " << (int)mapper_number << std::endl;
+    // The 512 byte trainer sits between the header and PRG ROM, if the file contains it
+    size_t offset = sizeof(CartHeader);
+    if (info.trainer)
+        offset += 512;
+
+    // The database is keyed on everything after that, so a header that gets the sizes wrong
+    //      still finds its entry. Nothing is hashed without a database
+    CartInfo entry;
+    if (RomDb::size() != 0 && image->size() > offset &&
+        RomDb::find(RomDb::crc32(image->data() + offset, image->size() - offset), entry)) {
+        entry.trainer = info.trainer;
+        entry.nes2    = info.nes2;
+        info = entry;
+    }
+
+    // Anything bigger is a broken header rather than a real cartridge
+    if (info.prg_rom == 0 || info.prg_rom > 0x1000000 || info.chr_rom > 0x1000000) {
+        std::cout << "Rom sizes in the header don't make sense" << std::endl;
+        return false;
+    }
+    if (!supports_mapper(info.mapper)) {
+        std::cout << "Unimplemented mapper type: " << info.mapper << std::endl;
         return false;
-    } 
+    }
+    if (info.region == CartInfo::pal || info.region == CartInfo::dendy)
+        std::cout << "Rom is made for PAL machines, running it with NTSC timing" << std::endl;
+
+    m_cart_header = header;
+    m_info = info;
+
+    m_prg_rom_size = m_info.prg_rom;
+    m_chr_rom_size = m_info.chr_rom;
+
+    // Roms cut short read as zeros past the end, which takes a padded copy of the image
+    if (image->size() < offset + m_prg_rom_size + m_chr_rom_size)
+        image = RomImage::copy(image->data(), image->size(), offset + m_prg_rom_size + m_chr_rom_size);
+
+    m_image   = image;
+    m_rom_crc_known = false;
+    m_prg_rom = m_image->data() + offset;
+    m_chr_rom = m_image->data() + offset + m_prg_rom_size;
+
+    // Without CHR ROM there is CHR RAM in its place, at least 8 KiB of it as the mappers
+    //      expect a full pattern table
+    size_t chr_ram = std::max<size_t>(m_info.chr_ram + m_info.chr_nvram, 0x2000);
+    m_chr_ram.assign(m_chr_rom_size == 0 ? chr_ram : 0, 0);
+    if (m_chr_rom_size == 0) {
+        m_chr_rom = m_chr_ram.data();
+        m_chr_rom_size = m_chr_ram.size();
+    }
+
+    // Same goes for PRG RAM, mappers always see a full 8 KiB page even on carts without any.
+    //      The trainer gets loaded into it at $7000
+    m_prg_ram.assign(std::max<size_t>(m_info.prg_ram + m_info.prg_nvram, 0x2000), 0);
+    if (m_info.trainer)
+        std::memcpy(&m_prg_ram[0x1000], m_image->data() + sizeof(CartHeader), 512);
+
+    // Initialize the mapper pointer, the mapper is known to be supported by now
+    init_mapper(m_info.mapper);
+
+    // Nothing is decoded until it is first used
+    m_chr_decoded.resize(m_chr_rom_size * 8);
+    m_chr_valid.assign(m_chr_rom_size / 16, false);
+    chr_banks_changed();
+
+    // The CPU bus still points into the rom this one replaced
+    if (m_cpu_bus != nullptr) m_cpu_bus->cart_changed();
 
-    rom_file.close();
     return true;
 }
 
 
+/* Bus connections ---------------------------------------- */
+
+void Cart::connect_bus(cpu_bus* cpu_bus_ptr) {
+    m_cpu_bus = cpu_bus_ptr;
+}
+
+
 /* Memory access by CPU ----------------------------------- */
 
-void Cart::cpu_WB(uint16_t addr, uint8_t value) {
-    m_mapper->cpu_WB(addr, value);
+const uint8_t* Cart::cpu_read_page(uint8_t page) {
+    return with_mapper([&](auto& mapper) { return mapper.cpu_read_page(page); });
 }
 
-uint8_t Cart::cpu_RB(uint16_t addr) {
-    return m_mapper->cpu_RB(addr);
+uint8_t* Cart::cpu_write_page(uint8_t page) {
+    return with_mapper([&](auto& mapper) { return mapper.cpu_write_page(page); });
+}
+
+void Cart::prg_banks_changed() {
+    if (m_cpu_bus != nullptr) m_cpu_bus->remap_cart();
 }
 
 
 /* Memory access by PPU ----------------------------------- */
 
 void Cart::ppu_WB(uint16_t addr, uint8_t value) {
-    m_mapper->ppu_WB(addr, value);
+    with_mapper([&](auto& mapper) { mapper.ppu_WB(addr, value); });
+
+    // Pattern data may have changed, decode the tile again when it is next used
+    if (addr <= 0x1FFF && m_chr_map[addr >> 10] >= 0)
+        m_chr_valid[(m_chr_map[addr >> 10] + (addr & 0x3FF)) >> 4] = false;
+}
+
+const uint8_t* Cart::chr_row(uint16_t addr, bool flip) {
+
+    // Rows always start in the low bit plane, anything else is left to the caller
+    int window = m_chr_map[(addr >> 10) & 0x7];
+    if (window < 0 || addr > 0x1FFF || (addr & 0x8) != 0) return nullptr;
+
+    int offset = window + (addr & 0x3FF);
+    if (!m_chr_valid[offset >> 4]) decode_tile(offset >> 4);
+
+    // Sixteen bytes per row, the flipped row follows the regular one
+    return &m_chr_decoded[(((offset >> 4) << 3) + (offset & 0x7)) * 16 + (flip ? 8 : 0)];
 }
 
-uint8_t Cart::ppu_RB(uint16_t addr) {
-    return m_mapper->ppu_RB(addr);
+void Cart::decode_tile(int tile) {
+
+    const uint8_t* data = &m_chr_rom[tile * 16];
+    uint8_t* decoded = &m_chr_decoded[tile * 128];
+
+    for (int row = 0; row < 8; row++, decoded += 16) {
+        uint8_t lo = data[row + 0], hi = data[row + 8];
+        for (int i = 0; i < 8; i++) {
+            decoded[i + 0] = ((lo >> (7 - i)) & 1) | (((hi >> (7 - i)) & 1) << 1);
+            decoded[i + 8] = ((lo >> i) & 1) | (((hi >> i) & 1) << 1);
+        }
+    }
+
+    m_chr_valid[tile] = true;
+}
+
+void Cart::chr_banks_changed() {
+
+    for (int window = 0; window < 8; window++) {
+        const uint8_t* data = with_mapper([&](auto& mapper) { return mapper.ppu_read_window(window); });
+        m_chr_map[window] = data ? (int)(data - m_chr_rom) : -1;
+    }
+
+}
+
+
+/* Interrupts --------------------------------------------- */
+
+void Cart::irq(bool asserted) {
+    if (m_cpu_bus == nullptr) return;
+    if (asserted) m_cpu_bus->irq();
+    else m_cpu_bus->irq_release();
 }
 
 
 /* Getters ------------------------------------------------ */
 
-uint8_t* Cart::get_PRG_ROM() {
-    return m_prg_rom.data();
+const uint8_t* Cart::get_PRG_ROM() {
+    return m_prg_rom;
+}
+
+const uint8_t* Cart::get_CHR_ROM() {
+    return m_chr_rom;
 }
 
-uint8_t* Cart::get_CHR_ROM() {
-    return m_chr_rom.data();
+uint8_t* Cart::get_CHR_RAM() {
+    return m_chr_ram.empty() ? nullptr : m_chr_ram.data();
 }
 
 uint8_t* Cart::get_PRG_RAM() {
     return m_prg_ram.data();
 }
 
+Mapper* Cart::virtual_mapper() {
+    return with_mapper([](auto& mapper) -> Mapper* { return &mapper; });
+}
 
-/* Return the mirroring mode being used ------------------- */
 
-ntMirrors::nameTableMirrorMode Cart::nt_mirror() {
+/* Reset signal to put cartridge in initial conditions ---- */
+
+void Cart::rst() {
+    with_mapper([](auto& mapper) { mapper.rst(); });
+    chr_banks_changed();
+}
 
-    // This bit being high indicates that bit zero (which normally dictates between
-    //      horizontal or vertical being pyisically soldered so that its always used)
-    //      should be used to determine mirroring.
-    //      ...
-    // Mirroring mode ignores this bit and is mapper based other wise
-    if ((m_cart_header.mapper_0 & 0x08) == 0x00)
-        return (m_cart_header.mapper_0 & 0x01) ?
-            ntMirrors::vertical  : 
-            ntMirrors::horizontal;
 
-    else return m_mapper->nt_mirror();
+/* Save states -------------------------------------------- */
+
+uint32_t Cart::rom_crc() const {
+
+    if (!m_rom_crc_known) {
+        // CHR RAM stands in for CHR ROM on carts without any, it isn't part of the rom
+        m_rom_crc = RomDb::crc32(m_chr_rom, m_info.chr_rom, RomDb::crc32(m_prg_rom, m_prg_rom_size));
+        m_rom_crc_known = true;
+    }
+    return m_rom_crc;
 
 }
 
+bool Cart::identified(StateReader& state) const {
 
-/* Reset signal to put cartridge in initial conditions ---- */
+    CartHeader header;
+    uint32_t crc = 0;
+    return state.get(header) && std::memcmp(&header, &m_cart_header, sizeof(CartHeader)) == 0
+        && state.get(crc) && crc == rom_crc();
 
-void Cart::rst() {
-    m_mapper->rst();
+}
+
+bool Cart::identifies(const std::vector<uint8_t>& state) const {
+
+    StateReader reader(state);
+    return reader.find("CART") && identified(reader);
+
+}
+
+void Cart::save(StateWriter& state) const {
+
+    state.section("CART");
+    state.put(m_cart_header);
+    state.put(rom_crc());
+
+    // CHR ROM never changes, only CHR RAM needs saving
+    state.bytes(m_prg_ram.data(), m_prg_ram.size());
+    state.bytes(m_chr_ram.data(), m_chr_ram.size());
+
+    std::visit([&](const auto& mapper) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(mapper)>, std::monostate>) mapper.save(state);
+    }, m_mapper);
+
+}
+
+bool Cart::load(StateReader& state) {
+
+    // The header decides the size of everything that follows. Other roms can share a header,
+    //      the CRC makes sure the state was saved from this one
+    state.section("CART");
+    if (!identified(state)) return false;
+
+    state.bytes(m_prg_ram.data(), m_prg_ram.size());
+    if (!m_chr_ram.empty()) {
+        state.bytes(m_chr_ram.data(), m_chr_ram.size());
+        m_chr_valid.assign(m_chr_valid.size(), false);
+    }
+
+    with_mapper([&](auto& mapper) { mapper.load(state); });
+
+    // Banks are likely to be different
+    chr_banks_changed();
+    prg_banks_changed();
+
+    return state.ok();
 }
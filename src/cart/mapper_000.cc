@@ -1,5 +1,5 @@
 #include <assert.h>
-#include "cart/mapper.hh"
+#include "cart/cart.hh"
 
 void Mapper_000::cpu_WB(uint16_t addr, uint8_t value) {
 
@@ -36,13 +36,23 @@ uint8_t Mapper_000::cpu_RB(uint16_t addr) {
     return 0x00;
 }
 
+const uint8_t* Mapper_000::cpu_read_page(uint8_t page) {
+
+    // PRG ROM, with a single bank the mask mirrors it twice
+    if (page >= 0x80)
+        return m_cart->get_PRG_ROM() + (((page - 0x80) << 8) & (m_size_prg_rom - 1));
+
+    return nullptr;
+}
+
 void Mapper_000::ppu_WB(uint16_t addr, uint8_t value) {
 
-    // CHR ROM
-    if (addr >= 0x0000 && addr <= 0x1FFF) {
+    // CHR RAM, writes to CHR ROM go nowhere
+    uint8_t* chr_ram = m_cart->get_CHR_RAM();
+    if (chr_ram != nullptr && addr >= 0x0000 && addr <= 0x1FFF) {
 
         // An assert really isn't needed here so
-        m_cart->get_CHR_ROM()[addr] = value;
+        chr_ram[addr] = value;
     
     }
 
@@ -61,6 +71,14 @@ uint8_t Mapper_000::ppu_RB(uint16_t addr) {
     return 0x00;
 }
 
+const uint8_t* Mapper_000::ppu_read_window(uint8_t window) {
+
+    // CHR ROM, some carts have none at all
+    if (m_size_chr_rom == 0) return nullptr;
+    return m_cart->get_CHR_ROM() + (window << 10);
+
+}
+
 // Return name table mirroring mode
 ntMirrors::nameTableMirrorMode Mapper_000::nt_mirror() {
 
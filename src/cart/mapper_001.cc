@@ -1,5 +1,6 @@
 #include <assert.h>
-#include "cart/mapper.hh"
+#include <algorithm>
+#include "cart/cart.hh"
 
 void Mapper_001::cpu_WB(uint16_t addr, uint8_t value) {
 
@@ -7,7 +8,7 @@ void Mapper_001::cpu_WB(uint16_t addr, uint8_t value) {
 
     if (addr >= 0x6000 && addr <= 0x7FFF) {
 
-        m_cart->get_PRG_RAM()[addr & 0x1FFF] = value;
+        if (m_prg_ram_enabled) m_cart->get_PRG_RAM()[addr & 0x1FFF] = value;
         return; // To avoid writing to registers
 
     }
@@ -21,67 +22,50 @@ void Mapper_001::cpu_WB(uint16_t addr, uint8_t value) {
     m_shift_register.value >>= 1; // Update shift register
     m_shift_register.value |= m_shift_register.data << 5;
 
-    // Reset shift register if needed
+    // Reset shift register if needed, which also goes back to fixing the last PRG bank
     if (m_shift_register.reset) {
         // Again, the one in 0x20 acts as a notifier bit
         //      to indicate that 5 bits have been written
         m_shift_register.value = 0x20;
+        m_reg_ctrl.raw |= 0x0C;
     }
     // If 5 bits written, write the value to the register
     else if (m_shift_register.value & 0x01) {
 
+        uint8_t reg = (m_shift_register.value >> 1) & 0x1F;
+
         // Control Register
-        if (addr >= 0x8000 && addr <= 0x9FFF) {
-            m_reg_ctrl.raw = (m_shift_register.value >> 1) & 0x1F;
-        }
+        if (addr >= 0x8000 && addr <= 0x9FFF) m_reg_ctrl.raw = reg;
 
         // CHR Bank 0
-        else if (addr >= 0xA000 && addr <= 0xBFFF) {
-            
-            m_chr_bank0 = (m_reg_ctrl.chrBankMode == 1) ?
-                (m_shift_register.value >> 1) & 0x1F:
-                (m_shift_register.value >> 1) & 0x1E; // Low bit ignored
-
-        }
+        else if (addr >= 0xA000 && addr <= 0xBFFF) m_chr_bank0 = reg;
 
         // CHR Bank 1
-        else if (addr >= 0xC000 && addr <= 0xDFFF) {
-            
-            if (m_reg_ctrl.chrBankMode == 1)
-                m_chr_bank1 = (m_shift_register.value >> 1) & 0x1F;
-
-            // NOTE: Writes here are ignored in 8 KB mode as only one bank
-            //      ends up being used
-
-        }
+        else if (addr >= 0xC000 && addr <= 0xDFFF) m_chr_bank1 = reg;
 
         // PRG Bank
-        else if (addr >= 0xE000 && addr <= 0xFFFF) {
-            
-            switch(m_reg_ctrl.prgBankMode) {
-
-            case 0: case 1:
-                m_prg_bank0 = (m_shift_register.value >> 1) & 0x1E; // Low bit ignored
-                break;
-            
-            case 2:
-                m_prg_bank0 = 0;
-                m_prg_bank1 = (m_shift_register.value >> 1) & 0x0F;
-                break;
-            
-            case 3:
-                m_prg_bank0 = (m_shift_register.value >> 1) & 0x0F;
-                m_prg_bank1 = (m_size_prg_rom / 0x4000) - 1; // Fixed at last bank
-                break;
-
-            }
-
-        }
+        else if (addr >= 0xE000 && addr <= 0xFFFF) m_prg_bank = reg;
 
         // This shouldn't happen
         else assert(false);
 
+        // Done shifting, start over for the next register
+        m_shift_register.value = 0x20;
+
     }
+    else return;
+
+    // Remapping the CPU bus isn't cheap, only bother when a bank actually moved
+    const uint8_t* prg_base[2] = { m_prg_base[0], m_prg_base[1] };
+    const uint8_t* chr_base[2] = { m_chr_base[0], m_chr_base[1] };
+    bool prg_ram_enabled = m_prg_ram_enabled;
+
+    update_banks();
+
+    if (prg_base[0] != m_prg_base[0] || prg_base[1] != m_prg_base[1] || prg_ram_enabled != m_prg_ram_enabled)
+        m_cart->prg_banks_changed();
+    if (chr_base[0] != m_chr_base[0] || chr_base[1] != m_chr_base[1])
+        m_cart->chr_banks_changed();
 
 }
 
@@ -89,44 +73,95 @@ uint8_t Mapper_001::cpu_RB(uint16_t addr) {
 
     if (addr >= 0x6000 && addr <= 0x7FFF) {
 
-        return m_cart->get_PRG_RAM()[addr & 0x1FFF];
+        // Disabled RAM reads as open bus
+        return m_prg_ram_enabled ? m_cart->get_PRG_RAM()[addr & 0x1FFF] : 0x00;
 
     }
 
     else if (addr >= 0x8000) {
 
-        if ((m_reg_ctrl.prgBankMode == 0) || (m_reg_ctrl.prgBankMode == 1)) {
+        return m_prg_base[(addr >> 14) & 0x1][addr & 0x3FFF];
+
+    }
+
+    return 0x00;
+}
+
+const uint8_t* Mapper_001::cpu_read_page(uint8_t page) {
 
-            // Higher bank value is ignored
-            return m_cart->get_PRG_ROM()[(addr & 0x7FFF) + (0x8000 * m_prg_bank0)];
+    if (page >= 0x60 && page <= 0x7F) {
 
-        }
+        return m_prg_ram_enabled ? m_cart->get_PRG_RAM() + ((page & 0x1F) << 8) : nullptr;
 
-        else {
-            
-            if (addr >= 0x8000 && addr <= 0xBFFF) {
-                return m_cart->get_PRG_ROM()[(addr & 0x3FFF) + (0x4000 * m_prg_bank0)];
-            }
+    }
 
-            else if (addr >= 0xC000 && addr <= 0xFFFF) {
-                return m_cart->get_PRG_ROM()[(addr & 0x3FFF) + (0x4000 * m_prg_bank1)];
-            }
+    else if (page >= 0x80) {
 
-        }
+        return m_prg_base[(page >> 6) & 0x1] + ((page & 0x3F) << 8);
 
     }
 
-    return 0x00;
+    return nullptr;
+}
+
+uint8_t* Mapper_001::cpu_write_page(uint8_t page) {
+
+    // Only RAM is written directly, everything else is a register write
+    if (page >= 0x60 && page <= 0x7F && m_prg_ram_enabled)
+        return m_cart->get_PRG_RAM() + ((page & 0x1F) << 8);
+
+    return nullptr;
 }
 
 void Mapper_001::ppu_WB(uint16_t addr, uint8_t value) {
 
+    // CHR RAM is banked the same way CHR ROM is, the bases point into it
+    uint8_t* chr_ram = m_cart->get_CHR_RAM();
+    if (chr_ram != nullptr && addr <= 0x1FFF)
+        chr_ram[(m_chr_base[addr >> 12] - m_cart->get_CHR_ROM()) + (addr & 0xFFF)] = value;
+
 }
 
 uint8_t Mapper_001::ppu_RB(uint16_t addr) {
+
+    if (addr <= 0x1FFF)
+        return m_chr_base[addr >> 12][addr & 0xFFF];
+
     return 0x00;
 }
 
+const uint8_t* Mapper_001::ppu_read_window(uint8_t window) {
+    return m_chr_base[window >> 2] + ((window & 0x3) << 10);
+}
+
+void Mapper_001::update_banks() {
+
+    // 16 KB PRG banks, in 32 KB mode the low bit is ignored and the pair switched together.
+    //      Banks past the end of PRG ROM wrap around
+    int prg_banks = std::max(m_size_prg_rom / 0x4000, 1);
+    int bank = m_prg_bank & 0x0F, prg[2];
+
+    switch (m_reg_ctrl.prgBankMode) {
+        case 0: case 1: prg[0] = bank & 0x0E; prg[1] = bank | 0x01;     break;
+        case 2:         prg[0] = 0;           prg[1] = bank;            break;
+        case 3:         prg[0] = bank;        prg[1] = prg_banks - 1;   break;
+    }
+
+    for (int i = 0; i < 2; i++)
+        m_prg_base[i] = m_cart->get_PRG_ROM() + (prg[i] % prg_banks) * 0x4000;
+
+    // 4 KB CHR banks, in 8 KB mode bank 0 switches both halves ignoring its low bit
+    int chr_banks = std::max(m_size_chr / 0x1000, 1);
+    int chr[2] = { m_chr_bank0, m_chr_bank1 };
+    if (m_reg_ctrl.chrBankMode == 0) { chr[0] = m_chr_bank0 & 0x1E; chr[1] = m_chr_bank0 | 0x01; }
+
+    for (int i = 0; i < 2; i++)
+        m_chr_base[i] = m_cart->get_CHR_ROM() + (chr[i] % chr_banks) * 0x1000;
+
+    m_prg_ram_enabled = (m_prg_bank & 0x10) == 0;
+
+}
+
 ntMirrors::nameTableMirrorMode Mapper_001::nt_mirror() {
     
     switch (m_reg_ctrl.mirroring) {
@@ -143,7 +178,28 @@ void Mapper_001::rst() {
     m_reg_ctrl.raw = 0x1C;
     m_chr_bank0 = 0x00;
     m_chr_bank1 = 0x00;
-    m_prg_bank0 = 0x00;
-    m_prg_bank1 = (m_size_prg_rom / 0x4000) - 1; // Init to last bank
+    m_prg_bank  = 0x00;
+    m_shift_register.value = 0x20;
+
+    update_banks();
+}
+
+void Mapper_001::save(StateWriter& state) const {
+
+    state.put(m_reg_ctrl.raw);
+    state.put(m_chr_bank0); state.put(m_chr_bank1);
+    state.put(m_prg_bank);
+    state.put(m_shift_register);
+
+}
+
+bool Mapper_001::load(StateReader& state) {
+
+    state.get(m_reg_ctrl.raw);
+    state.get(m_chr_bank0); state.get(m_chr_bank1);
+    state.get(m_prg_bank);
+    state.get(m_shift_register);
 
+    update_banks();
+    return state.ok();
 }
@@ -1,5 +1,5 @@
 #include <cassert>
-#include "cart/mapper.hh"
+#include "cart/cart.hh"
 #include "mirrors.hh"
 
 void Mapper_002::cpu_WB(uint16_t addr, uint8_t value) {
@@ -7,6 +7,7 @@ void Mapper_002::cpu_WB(uint16_t addr, uint8_t value) {
     // Write to low bank, only 4 bits
     if (addr >= 0x8000 && addr <= 0xFFFF) {
         m_prg_bank_lo = value & 0x0F;
+        m_cart->prg_banks_changed();
     }
 
 }
@@ -28,11 +29,27 @@ uint8_t Mapper_002::cpu_RB(uint16_t addr) {
     return data;
 }
 
+const uint8_t* Mapper_002::cpu_read_page(uint8_t page) {
+
+    // Bank numbers past the end of PRG ROM wrap around
+    int offset = (page & 0x3F) << 8;
+
+    // Low bank
+    if (page >= 0x80 && page <= 0xBF)
+        return m_cart->get_PRG_ROM() + (0x4000 * (m_prg_bank_lo % m_prg_banks)) + offset;
+
+    // Fixed high bank
+    else if (page >= 0xC0)
+        return m_cart->get_PRG_ROM() + (0x4000 * (m_prg_bank_hi % m_prg_banks)) + offset;
+
+    return nullptr;
+}
+
 void Mapper_002::ppu_WB(uint16_t addr, uint8_t value) {
 
     // CHR ROM - treated like ram when nr_chr_banks == 0
     if (m_chr_banks == 0 && addr >= 0x0000 && addr <= 0x1FFF) {
-        m_cart->get_CHR_ROM()[addr] = value;
+        m_cart->get_CHR_RAM()[addr] = value;
     }
 
 }
@@ -48,6 +65,13 @@ uint8_t Mapper_002::ppu_RB(uint16_t addr) {
     return data;
 }
 
+const uint8_t* Mapper_002::ppu_read_window(uint8_t window) {
+
+    // CHR ROM or CHR RAM, both are never banked
+    return m_cart->get_CHR_ROM() + (window << 10);
+
+}
+
 ntMirrors::nameTableMirrorMode Mapper_002::nt_mirror() {
 
     return m_mirroring;
@@ -62,3 +86,17 @@ void Mapper_002::rst() {
     m_prg_bank_hi = m_prg_banks - 1;
 }
 
+void Mapper_002::save(StateWriter& state) const {
+
+    state.put(m_mirroring);
+    state.put(m_prg_bank_lo); state.put(m_prg_bank_hi);
+
+}
+
+bool Mapper_002::load(StateReader& state) {
+
+    state.get(m_mirroring);
+    state.get(m_prg_bank_lo); state.get(m_prg_bank_hi);
+
+    return state.ok();
+}
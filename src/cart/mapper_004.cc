@@ -0,0 +1,212 @@
+#include <algorithm>
+#include "cart/cart.hh"
+
+// MMC3, https://www.nesdev.org/wiki/MMC3
+
+void Mapper_004::cpu_WB(uint16_t addr, uint8_t value) {
+
+    /* Handle writes to RAM */
+
+    if (addr >= 0x6000 && addr <= 0x7FFF) {
+
+        // The RAM protect bits in $A001 are left alone, MMC6 games write
+        //      the same address expecting something else entirely
+        m_cart->get_PRG_RAM()[addr & 0x1FFF] = value;
+        return;
+
+    }
+
+
+    /* Handle writes to registers, even and odd addresses of each 8 KB
+       range are two different registers */
+
+    bool odd = addr & 0x1;
+
+    // Bank select and bank data
+    if (addr >= 0x8000 && addr <= 0x9FFF) {
+
+        if (odd) m_banks[m_bank_select & 0x7] = value;
+        else m_bank_select = value;
+
+        // Remapping the CPU bus isn't cheap and most writes don't move anything, selecting
+        //      the bank register to write next only does when the swap bits change
+        int prg_offsets[4], chr_offsets[8];
+        std::copy(m_prg_offsets, m_prg_offsets + 4, prg_offsets);
+        std::copy(m_chr_offsets, m_chr_offsets + 8, chr_offsets);
+
+        update_banks();
+
+        if (!std::equal(m_prg_offsets, m_prg_offsets + 4, prg_offsets)) m_cart->prg_banks_changed();
+        if (!std::equal(m_chr_offsets, m_chr_offsets + 8, chr_offsets)) m_cart->chr_banks_changed();
+
+    }
+
+    // Mirroring, RAM protect is ignored (see above)
+    else if (addr >= 0xA000 && addr <= 0xBFFF) {
+
+        if (!odd) m_vertical = (value & 0x1) == 0;
+
+    }
+
+    // IRQ latch and reload
+    else if (addr >= 0xC000 && addr <= 0xDFFF) {
+
+        if (odd) { m_irq_counter = 0; m_irq_reload = true; }
+        else m_irq_latch = value;
+
+    }
+
+    // IRQ disable and enable, disabling also acknowledges a pending IRQ
+    else if (addr >= 0xE000) {
+
+        m_irq_enabled = odd;
+        if (!odd) m_cart->irq(false);
+
+    }
+
+}
+
+uint8_t Mapper_004::cpu_RB(uint16_t addr) {
+
+    if (addr >= 0x6000 && addr <= 0x7FFF)
+        return m_cart->get_PRG_RAM()[addr & 0x1FFF];
+
+    else if (addr >= 0x8000)
+        return m_cart->get_PRG_ROM()[m_prg_offsets[(addr >> 13) & 0x3] + (addr & 0x1FFF)];
+
+    return 0x00;
+}
+
+const uint8_t* Mapper_004::cpu_read_page(uint8_t page) {
+
+    if (page >= 0x60 && page <= 0x7F)
+        return m_cart->get_PRG_RAM() + ((page & 0x1F) << 8);
+
+    else if (page >= 0x80)
+        return m_cart->get_PRG_ROM() + m_prg_offsets[(page >> 5) & 0x3] + ((page & 0x1F) << 8);
+
+    return nullptr;
+}
+
+uint8_t* Mapper_004::cpu_write_page(uint8_t page) {
+
+    // Only RAM is written directly, everything else is a register write
+    if (page >= 0x60 && page <= 0x7F)
+        return m_cart->get_PRG_RAM() + ((page & 0x1F) << 8);
+
+    return nullptr;
+}
+
+void Mapper_004::ppu_WB(uint16_t addr, uint8_t value) {
+
+    // CHR RAM is banked the same way CHR ROM is
+    uint8_t* chr_ram = m_cart->get_CHR_RAM();
+    if (chr_ram != nullptr && addr <= 0x1FFF)
+        chr_ram[m_chr_offsets[addr >> 10] + (addr & 0x3FF)] = value;
+
+}
+
+uint8_t Mapper_004::ppu_RB(uint16_t addr) {
+
+    if (addr <= 0x1FFF)
+        return m_cart->get_CHR_ROM()[m_chr_offsets[addr >> 10] + (addr & 0x3FF)];
+
+    return 0x00;
+}
+
+const uint8_t* Mapper_004::ppu_read_window(uint8_t window) {
+    return m_cart->get_CHR_ROM() + m_chr_offsets[window];
+}
+
+void Mapper_004::update_banks() {
+
+    // 8 KB PRG banks, the last two banks of the rom are fixed and bit 6 of bank select
+    //      decides which of them moves up to $8000 in place of R6
+    int prg_banks = m_size_prg_rom / 0x2000;
+    int second_last = prg_banks - 2, r6 = m_banks[6] % prg_banks, r7 = m_banks[7] % prg_banks;
+
+    int prg[4] = { r6, r7, second_last, prg_banks - 1 };
+    if (m_bank_select & 0x40) std::swap(prg[0], prg[2]);
+    for (int i = 0; i < 4; i++) m_prg_offsets[i] = prg[i] * 0x2000;
+
+    // 1 KB CHR banks, R0 and R1 switch 2 KB at a time ignoring their low bit. Bit 7 of
+    //      bank select swaps the two halves of the pattern tables
+    int chr_banks = m_size_chr / 0x400;
+    int chr[8] = {
+        m_banks[0] & 0xFE, m_banks[0] | 0x01, m_banks[1] & 0xFE, m_banks[1] | 0x01,
+        m_banks[2], m_banks[3], m_banks[4], m_banks[5]
+    };
+    int invert = (m_bank_select & 0x80) ? 4 : 0;
+    for (int i = 0; i < 8; i++) m_chr_offsets[i ^ invert] = (chr[i] % chr_banks) * 0x400;
+
+}
+
+ntMirrors::nameTableMirrorMode Mapper_004::nt_mirror() {
+
+    return m_vertical ? ntMirrors::vertical : ntMirrors::horizontal;
+
+}
+
+void Mapper_004::rst() {
+
+    m_bank_select = 0x00;
+    const uint8_t banks[8] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    std::copy(banks, banks + 8, m_banks);
+    m_vertical = m_header_vertical;
+
+    m_irq_latch = m_irq_counter = 0;
+    m_irq_reload = m_irq_enabled = false;
+    m_cart->irq(false);
+
+    update_banks();
+}
+
+/* Scanline counter --------------------------------------- */
+
+void Mapper_004::clock_scanline() {
+
+    if (m_irq_counter == 0 || m_irq_reload) {
+        m_irq_counter = m_irq_latch;
+        m_irq_reload = false;
+    }
+    else --m_irq_counter;
+
+    // Held until acknowledged through $E000
+    if (m_irq_counter == 0 && m_irq_enabled) m_cart->irq(true);
+
+}
+
+int Mapper_004::scanlines_until_irq() const {
+
+    if (!m_irq_enabled) return -1;
+
+    // Counting down from where it is, or from the latch after reloading on the next clock.
+    //      A latch of zero raises IRQ on every clock
+    if (m_irq_counter != 0 && !m_irq_reload) return m_irq_counter;
+    return 1 + m_irq_latch;
+
+}
+
+/* Save states -------------------------------------------- */
+
+void Mapper_004::save(StateWriter& state) const {
+
+    state.put(m_bank_select);
+    state.put(m_banks);
+    state.put(m_vertical);
+    state.put(m_irq_latch); state.put(m_irq_counter);
+    state.put(m_irq_reload); state.put(m_irq_enabled);
+
+}
+
+bool Mapper_004::load(StateReader& state) {
+
+    state.get(m_bank_select);
+    state.get(m_banks);
+    state.get(m_vertical);
+    state.get(m_irq_latch); state.get(m_irq_counter);
+    state.get(m_irq_reload); state.get(m_irq_enabled);
+
+    update_banks();
+    return state.ok();
+}
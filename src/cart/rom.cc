@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "cart/rom.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage() : m_data(nullptr), m_size(0), m_mapped(false) {}
+
+RomImage::~RomImage() {
+
+    #ifdef ROM_MMAP
+    if (m_mapped) munmap((void*)m_data, m_size);
+    #endif
+
+}
+
+std::shared_ptr<const RomImage> RomImage::copy(const uint8_t* data, size_t size, size_t padded) {
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->m_copy.assign(std::max(size, padded), 0);
+    std::copy(data, data + size, image->m_copy.begin());
+
+    image->m_data = image->m_copy.data();
+    image->m_size = image->m_copy.size();
+    return image;
+
+}
+
+// The whole file read into a copy, for where mapping it isn't possible
+static std::shared_ptr<const RomImage> read_file(const std::string& path) {
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return nullptr;
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return RomImage::copy(data.data(), data.size());
+
+}
+
+#ifdef ROM_MMAP
+
+std::shared_ptr<const RomImage> RomImage::open(const std::string& path) {
+
+    // Files already open, by which file it is and which version of it. Images close themselves
+    //      once the last cartridge using them goes, so the map only holds on to them weakly
+    using Key = std::tuple<dev_t, ino_t, off_t, time_t, long>;
+    static std::mutex open_mutex;
+    static std::map<Key, std::weak_ptr<const RomImage>> open_images;
+
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return nullptr;
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close(file);
+        return nullptr;
+    }
+
+    #ifdef __APPLE__
+    Key key(info.st_dev, info.st_ino, info.st_size, info.st_mtimespec.tv_sec, info.st_mtimespec.tv_nsec);
+    #else
+    Key key(info.st_dev, info.st_ino, info.st_size, info.st_mtim.tv_sec, info.st_mtim.tv_nsec);
+    #endif
+
+    std::lock_guard<std::mutex> lock(open_mutex);
+    if (std::shared_ptr<const RomImage> image = open_images[key].lock()) {
+        close(file);
+        return image;
+    }
+
+    // Nothing to map in an empty file
+    void* data = info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    close(file);
+    if (data == MAP_FAILED) return read_file(path);
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->m_data = (const uint8_t*)data;
+    image->m_size = info.st_size;
+    image->m_mapped = true;
+
+    // Clean up after images closed since, while the lock is held anyway
+    for (auto entry = open_images.begin(); entry != open_images.end();)
+        entry = entry->second.expired() ? open_images.erase(entry) : std::next(entry);
+
+    open_images[key] = image;
+    return image;
+
+}
+
+#else
+
+std::shared_ptr<const RomImage> RomImage::open(const std::string& path) {
+    return read_file(path);
+}
+
+#endif
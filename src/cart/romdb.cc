@@ -0,0 +1,216 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+#include "cart/romdb.hh"
+
+/* Header decoding ---------------------------------------- */
+
+// NES 2.0 rom sizes, in units or as an exponent and multiplier when the upper nibble is all set
+static size_t rom_size(uint8_t lsb, uint8_t msb, size_t unit) {
+    if (msb != 0xF) return (((size_t)msb << 8) | lsb) * unit;
+    if ((lsb >> 2) > 30) return SIZE_MAX; // Never going to fit anywhere
+    return ((size_t)1 << (lsb >> 2)) * ((lsb & 0x3) * 2 + 1);
+}
+
+// NES 2.0 RAM sizes are shift counts, 64 << shift bytes or none at all when zero
+static size_t ram_size(uint8_t shift) {
+    return shift == 0 ? 0 : (size_t)64 << shift;
+}
+
+bool CartInfo::parse(const uint8_t* header) {
+
+    // "NES" followed by MS-DOS end-of-file
+    if (std::memcmp(header, "NES\x1A", 4) != 0) return false;
+
+    *this = CartInfo();
+    vertical    = (header[6] & 0x01) != 0;
+    battery     = (header[6] & 0x02) != 0;
+    trainer     = (header[6] & 0x04) != 0;
+    four_screen = (header[6] & 0x08) != 0;
+    mapper      = (header[6] >> 4) | (header[7] & 0xF0);
+
+    // NES 2.0 headers are marked by bits 2 and 3 of byte 7 being 10
+    //      https://www.nesdev.org/wiki/NES_2.0
+    nes2 = (header[7] & 0x0C) == 0x08;
+
+    if (nes2) {
+
+        mapper   |= (header[8] & 0x0F) << 8;
+        submapper = header[8] >> 4;
+
+        prg_rom = rom_size(header[4], header[9] & 0x0F, 0x4000);
+        chr_rom = rom_size(header[5], header[9] >> 4, 0x2000);
+
+        prg_ram = ram_size(header[10] & 0x0F); prg_nvram = ram_size(header[10] >> 4);
+        chr_ram = ram_size(header[11] & 0x0F); chr_nvram = ram_size(header[11] >> 4);
+
+        region = (Region)(header[12] & 0x03);
+
+    }
+
+    else {
+
+        // Old dumping tools left their name ("DiskDude!" and such) over bytes 7 - 15, which
+        //      then can't be trusted for anything, the upper half of the mapper number included
+        bool junk = header[12] != 0 || header[13] != 0 || header[14] != 0 || header[15] != 0;
+        if (junk) mapper &= 0x0F;
+
+        prg_rom = 0x4000 * (size_t)header[4];
+        chr_rom = 0x2000 * (size_t)header[5];
+
+        // Zero PRG RAM means one page, docs say so
+        prg_ram = 0x2000 * (size_t)((junk || header[8] == 0) ? 1 : header[8]);
+        chr_ram = chr_rom == 0 ? 0x2000 : 0;
+
+        region = (!junk && (header[9] & 0x01)) ? pal : ntsc;
+
+    }
+
+    return true;
+}
+
+
+/* CRC32 -------------------------------------------------- */
+
+// Slicing by 8, table k holds the CRC of a byte followed by k zero bytes so that eight bytes
+//      can be folded in with eight independent lookups rather than a chain of eight
+//      https://create.stephan-brumme.com/crc32/#slicing-by-8-overview
+struct CrcTables {
+    uint32_t table[8][256];
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            table[0][i] = crc;
+        }
+        for (int k = 1; k < 8; k++)
+            for (int i = 0; i < 256; i++)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+    }
+};
+
+uint32_t RomDb::crc32(const uint8_t* data, size_t size, uint32_t crc) {
+
+    static const CrcTables tables;
+    const auto& t = tables.table;
+    crc = ~crc;
+
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, data + 0, 4);
+        std::memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    #endif
+
+    // Whatever is left a byte at a time
+    for (; size > 0; data++, size--)
+        crc = t[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+
+/* Database ----------------------------------------------- */
+
+static std::unordered_map<uint32_t, CartInfo> database;
+
+// Parse the next whitespace separated number, hex for the CRC and decimal for everything else
+static bool number(const char*& cursor, unsigned long long& value, int base) {
+    char* end;
+    value = std::strtoull(cursor, &end, base);
+    if (end == cursor) return false;
+    cursor = end;
+    return true;
+}
+
+// Parse the next whitespace separated letter
+static char letter(const char*& cursor) {
+    while (*cursor == ' ' || *cursor == '\t') cursor++;
+    return *cursor == '\0' ? '\0' : *cursor++;
+}
+
+// One line of the database, see romdb.txt:
+//      crc32 prg_rom chr_rom mapper submapper mirroring prg_ram prg_nvram chr_ram chr_nvram region
+static bool parse_entry(const char* cursor, uint32_t& crc, CartInfo& info) {
+
+    unsigned long long value[10];
+    if (!number(cursor, value[0], 16)) return false;
+    for (int i = 1; i < 5; i++)
+        if (!number(cursor, value[i], 10)) return false;
+    char mirroring = letter(cursor);
+    for (int i = 5; i < 9; i++)
+        if (!number(cursor, value[i], 10)) return false;
+    char region = letter(cursor);
+
+    crc = (uint32_t)value[0];
+    info = CartInfo();
+    info.prg_rom   = value[1]; info.chr_rom   = value[2];
+    info.mapper    = value[3]; info.submapper = value[4];
+    info.prg_ram   = value[5]; info.prg_nvram = value[6];
+    info.chr_ram   = value[7]; info.chr_nvram = value[8];
+    info.battery   = info.prg_nvram != 0 || info.chr_nvram != 0;
+
+    switch (mirroring) {
+        case 'H': break;
+        case 'V': info.vertical = true; break;
+        case '4': info.four_screen = true; break;
+        default: return false;
+    }
+
+    switch (region) {
+        case 'N': info.region = CartInfo::ntsc;  break;
+        case 'P': info.region = CartInfo::pal;   break;
+        case 'M': info.region = CartInfo::multi; break;
+        case 'D': info.region = CartInfo::dendy; break;
+        default: return false;
+    }
+
+    return true;
+}
+
+bool RomDb::load(const std::string& path) {
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    text.push_back('\0');
+
+    // Roughly 60 characters a line, sized up front so the table never rehashes while loading
+    database.clear();
+    database.reserve(text.size() / 48);
+
+    for (char* line = text.data(); *line != '\0';) {
+
+        char* end = std::strchr(line, '\n');
+        if (end != nullptr) *end = '\0';
+
+        // Blank lines, comments and anything that doesn't parse are skipped
+        uint32_t crc;
+        CartInfo info;
+        if (line[0] != '#' && parse_entry(line, crc, info))
+            database[crc] = info;
+
+        if (end == nullptr) break;
+        line = end + 1;
+    }
+
+    return true;
+}
+
+bool RomDb::find(uint32_t crc, CartInfo& info) {
+    auto entry = database.find(crc);
+    if (entry == database.end()) return false;
+    info = entry->second;
+    return true;
+}
+
+size_t RomDb::size() {
+    return database.size();
+}
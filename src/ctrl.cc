@@ -1,17 +1,4 @@
 #include "ctrl.hh"
-#include <SDL2/SDL.h>
-
-// I'm sorry, I can't resist, cursed macros are just so much fun
-#define LIST_BUTTONS(X) \
-    /*name,     SDL scancode,      index*/ \
-    X("up",     SDL_SCANCODE_W,         4) \
-    X("left",   SDL_SCANCODE_A,         6) \
-    X("down",   SDL_SCANCODE_S,         5) \
-    X("right",  SDL_SCANCODE_D,         7) \
-    X("start",  SDL_SCANCODE_ESCAPE,    2) \
-    X("select", SDL_SCANCODE_BACKSPACE, 3) \
-    X("A",      SDL_SCANCODE_L,         0) \
-    X("B",      SDL_SCANCODE_J,         1)
 
 Controller::Controller() {
     for (bool& t : m_btnStates) 
@@ -19,12 +6,10 @@ Controller::Controller() {
     m_shift = 0;
 }
 
-void Controller::update(const uint8_t *keystate) {
-    #define X(name, scancode, index) \
-        m_btnStates[index] = keystate[scancode];
-    LIST_BUTTONS(X)
-    #undef X
-} 
+void Controller::set_buttons(uint8_t buttons) {
+    for (int index = 0; index < 8; index++)
+        m_btnStates[index] = (buttons >> index) & 1;
+}
 
 uint8_t Controller::r_joypad() {
     
@@ -38,3 +23,22 @@ void Controller::w_joypad(uint8_t value) {
     // Tell controller its ready for A
     m_shift = 0;
 }
+
+/* Save states -------------------------------------------- */
+
+void Controller::save(StateWriter& state) const {
+
+    state.section("CTRL");
+    state.put(m_btnStates);
+    state.put(m_shift);
+
+}
+
+bool Controller::load(StateReader& state) {
+
+    state.section("CTRL");
+    state.get(m_btnStates);
+    state.get(m_shift);
+
+    return state.ok();
+}
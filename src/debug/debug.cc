@@ -97,10 +97,16 @@ void Debugger::update_display() {
     refresh();
 }
 
-void Debugger::set_cpu_context(CpuContext& ctx) {
+void Debugger::cpu_access(uint16_t addr, BreakpointType t) {
+    do_break(addr, t);
+}
+
+void Debugger::cpu_step(const CpuContext& ctx) {
     m_cpu_context = ctx;
+    // Handle execution breakpoints
+    do_break(ctx.reg_pc, ex);
 }
 
-void Debugger::set_ppu_context(PpuContext& ctx) {
+void Debugger::ppu_step(const PpuContext& ctx) {
     m_ppu_context = ctx;
 }
@@ -1,11 +1,12 @@
 #include "gamegenie.hh"
+#include <algorithm>
 #include <cassert>
-#include <vector>
+#include <tuple>
 
 GameGenie::GameGenie()
 {
-    code_meta_8_chars = { };
-    code_meta_6_chars = { };
+    patches = { };
+    std::fill(std::begin(patched_pages), std::end(patched_pages), 0);
 }
 
 /*
@@ -18,23 +19,42 @@ GameGenie::GameGenie()
 std::uint8_t
 GameGenie::RB(std::uint16_t addr, std::uint8_t byte_read)
 {
-    /* Search 6-character cheat codes */
-    if (auto search = code_meta_6_chars.find(addr); search != code_meta_6_chars.end())
-        return code_meta_6_chars.at(addr);
-
-    /* Search 8-character cheat codes */
-    if (auto search = code_meta_8_chars.find(addr); search != code_meta_8_chars.end()) {
-        const auto [data, compare] = code_meta_8_chars.at(addr);
-
-        /* For 8-character codes, the replacement value is only returned when the
-         * compare matches the byte read to compensate for potential bank switching */
-        if (byte_read == compare)
-            return data;
-    }
+    auto search = std::lower_bound(patches.begin(), patches.end(), addr,
+        [](const Patch &p, std::uint16_t a) { return p.addr < a; });
+    if (search == patches.end() || search->addr != addr)
+        return byte_read;
+
+    /* 6-character cheat codes */
+    if (search->has_replace)
+        return search->replace;
+
+    /* For 8-character codes, the replacement value is only returned when the
+     * compare matches the byte read to compensate for potential bank switching */
+    if (search->has_compare && byte_read == search->compare)
+        return search->data;
 
     return byte_read;
 }
 
+/*
+ * Returns the patch for the given address, inserting an empty one in order
+ * if there isn't one yet, and marks its page as patched.
+ */
+GameGenie::Patch &
+GameGenie::patch_at(std::uint16_t addr)
+{
+    auto search = std::lower_bound(patches.begin(), patches.end(), addr,
+        [](const Patch &p, std::uint16_t a) { return p.addr < a; });
+    if (search == patches.end() || search->addr != addr)
+        search = patches.insert(search, { addr, false, false, 0, 0, 0 });
+
+    std::uint8_t page = addr >> 8;
+    assert(page >= 0x80);
+    patched_pages[(page - 0x80) >> 3] |= 1 << (page & 7);
+
+    return *search;
+}
+
 void
 GameGenie::add_code(const std::string &code)
 {
@@ -43,7 +63,9 @@ GameGenie::add_code(const std::string &code)
         std::uint8_t data = 0;
 
         std::tie(addr, data) = decode_6_char_code(code);
-        code_meta_6_chars[addr] = data;
+        Patch &patch = patch_at(addr);
+        patch.has_replace = true;
+        patch.replace = data;
     }
 
     else if (code.size() == 8) {
@@ -51,7 +73,9 @@ GameGenie::add_code(const std::string &code)
         std::uint16_t addr = 0;
 
         std::tie(addr, data_compare) = decode_8_char_code(code);
-        code_meta_8_chars[addr] = data_compare;
+        Patch &patch = patch_at(addr);
+        patch.has_compare = true;
+        std::tie(patch.data, patch.compare) = data_compare;
     }
 
     else
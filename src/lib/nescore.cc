@@ -0,0 +1,74 @@
+#include <cstring>
+#include <new>
+#include "cart/romdb.hh"
+#include "nescore.h"
+#include "nes.hh"
+
+static_assert(NESCORE_WIDTH == TV_W && NESCORE_HEIGHT == TV_H, "frame buffer dimensions");
+static_assert(sizeof(unsigned int) == sizeof(uint32_t), "frame buffer pixels are 32 bits");
+
+struct nescore {
+    nes machine;
+    std::vector<uint8_t> state; // Reused between saves
+};
+
+int nescore_version(void) {
+    return NESCORE_VERSION;
+}
+
+int nescore_load_romdb(const char* path) {
+    return RomDb::load(path) ? 1 : 0;
+}
+
+nescore* nescore_create(void) {
+    return new (std::nothrow) nescore;
+}
+
+void nescore_destroy(nescore* core) {
+    delete core;
+}
+
+int nescore_load_rom(nescore* core, const void* rom, size_t size) {
+
+    if (!core->machine.load_cart((const uint8_t*)rom, size)) return 0;
+    core->machine.reset();
+    return 1;
+
+}
+
+void nescore_reset(nescore* core) {
+    core->machine.reset();
+}
+
+void nescore_step_frame(nescore* core, uint8_t buttons) {
+    if (core->machine.cart_loaded()) core->machine.run_frame(buttons);
+}
+
+const uint32_t* nescore_framebuffer(const nescore* core) {
+    return (const uint32_t*)core->machine.frame();
+}
+
+uint8_t* nescore_ram(nescore* core, size_t* size) {
+    if (size != nullptr) *size = 0x0800;
+    return core->machine.ram();
+}
+
+unsigned long long nescore_instructions(const nescore* core) {
+    return core->machine.instructions();
+}
+
+size_t nescore_save_state(nescore* core, void* buffer, size_t capacity) {
+
+    core->machine.save_state(core->state);
+    if (buffer != nullptr && core->state.size() <= capacity)
+        std::memcpy(buffer, core->state.data(), core->state.size());
+    return core->state.size();
+
+}
+
+int nescore_load_state(nescore* core, const void* state, size_t size) {
+
+    core->state.assign((const uint8_t*)state, (const uint8_t*)state + size);
+    return core->machine.load_state(core->state) ? 1 : 0;
+
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "gamegenie.hh"
 #include "mirrors.hh"
 #include "memory.hh"
@@ -13,15 +14,34 @@ cpu_bus::cpu_bus() {
     // Allocate memory for CPU ram
     m_ram = std::make_unique<uint8_t[]>(0x0800);
 
+    // No cheats until a Game Genie is connected
+    m_gg = nullptr;
+
+    // Nothing is mapped to any of the IO registers until components are connected
+    for (auto& write_function : m_io_writes) write_function = nullptr;
+    for (auto& read_function  : m_io_reads ) read_function  = nullptr;
+
+    // RAM - Address Range 0x0000 - 0x2000, the 2 KiB is mirrored four times. Everything
+    //      else goes through the address decode until a cartridge is mapped in
+    for (int page = 0x00; page <= 0xFF; page++) {
+        m_read_pages[page]  = m_write_pages[page] = m_code_pages[page] = nullptr;
+        m_code_writes[page] = 0;
+        if (page <= 0x1F)
+            m_read_pages[page] = m_write_pages[page] = &m_ram[(page & 0x07) << 8];
+        if (page >= 0x80)
+            m_cart_read_pages[page - 0x80] = nullptr;
+    }
+
 }
 
 /* Conecct controllers ------------------------------------ */
 
 void cpu_bus::connect_ctrl(Controller* ctrl_ptr) {
+    using namespace AddressMirrors::CpuBus;
     m_ctrl = ctrl_ptr;
 
-    m_io_writes[0x4016] = [](cpu_bus& t, uint8_t value) { t.m_ctrl->w_joypad(value); };
-     m_io_reads[0x4016] = [](cpu_bus& t) { return t.m_ctrl->r_joypad(); };
+    m_io_writes[io_index(0x4016)] = [](cpu_bus& t, uint8_t value) { t.m_ctrl->w_joypad(value); };
+     m_io_reads[io_index(0x4016)] = [](cpu_bus& t) { return t.m_ctrl->r_joypad(); };
 
 }
 
@@ -38,37 +58,38 @@ void cpu_bus::connect_cpu(Ricoh2A03* cpu_ptr) {
 }
 
 void cpu_bus::connect_ppu(Ricoh2C02* ppu_ptr) {
+    using namespace AddressMirrors::CpuBus;
     m_ppu = ppu_ptr;
 
     /* Map MMIO registers to respective addresses */
     
     //                                                ctrl1 - Mapped to memory address 0x2000
-    m_io_writes[0x2000] = [](cpu_bus& t, uint8_t value) { t.m_ppu->ctrl1_w(value); };
-     m_io_reads[0x2000] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x2000)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->ctrl1_w(value); };
+     m_io_reads[io_index(0x2000)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
     //                                                crtl2 - Mapped to memory address 0x2001
-    m_io_writes[0x2001] = [](cpu_bus& t, uint8_t value) { t.m_ppu->ctrl2_w(value); };
-     m_io_reads[0x2001] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x2001)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->ctrl2_w(value); };
+     m_io_reads[io_index(0x2001)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
     //                                               status - Mapped to memory address 0x2002
-    m_io_writes[0x2002] = [](cpu_bus& t, uint8_t value) { t.m_ppu->status_w(value); };
-     m_io_reads[0x2002] = [](cpu_bus& t) { return t.m_ppu->status_r(); };
+    m_io_writes[io_index(0x2002)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->status_w(value); };
+     m_io_reads[io_index(0x2002)] = [](cpu_bus& t) { return t.m_ppu->status_r(); };
     //                                             spr_addr - Mapped to memory address 0x2003
-    m_io_writes[0x2003] = [](cpu_bus& t, uint8_t value) { t.m_ppu->spr_addr_w(value); };
-     m_io_reads[0x2003] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x2003)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->spr_addr_w(value); };
+     m_io_reads[io_index(0x2003)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
     //                                               spr_io - Mapped to memory address 0x2004
-    m_io_writes[0x2004] = [](cpu_bus& t, uint8_t value) { t.m_ppu->spr_io_w(value); };
-     m_io_reads[0x2004] = [](cpu_bus& t) { return t.m_ppu->spr_io_r(); };
+    m_io_writes[io_index(0x2004)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->spr_io_w(value); };
+     m_io_reads[io_index(0x2004)] = [](cpu_bus& t) { return t.m_ppu->spr_io_r(); };
     //                                           vram_addr1 - Mapped to memory address 0x2005
-    m_io_writes[0x2005] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_addr1_w(value); };
-     m_io_reads[0x2005] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x2005)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_addr1_w(value); };
+     m_io_reads[io_index(0x2005)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
     //                                           vram_addr2 - Mapped to memory address 0x2006
-    m_io_writes[0x2006] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_addr2_w(value); };
-     m_io_reads[0x2006] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x2006)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_addr2_w(value); };
+     m_io_reads[io_index(0x2006)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
     //                                              vram_io - Mapped to memory address 0x2007
-    m_io_writes[0x2007] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_io_w(value); };
-     m_io_reads[0x2007] = [](cpu_bus& t) { return t.m_ppu->vram_io_r(); };
+    m_io_writes[io_index(0x2007)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->vram_io_w(value); };
+     m_io_reads[io_index(0x2007)] = [](cpu_bus& t) { return t.m_ppu->vram_io_r(); };
     //                                              oam_dma - Mapped to memory address 0x4014
-    m_io_writes[0x4014] = [](cpu_bus& t, uint8_t value) { t.m_ppu->oam_dma_w(value, t.m_elapsed_clocks); };
-     m_io_reads[0x4014] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
+    m_io_writes[io_index(0x4014)] = [](cpu_bus& t, uint8_t value) { t.m_ppu->oam_dma_w(value, t.m_elapsed_clocks); };
+     m_io_reads[io_index(0x4014)] = [](cpu_bus& t) { return t.m_ppu->open_bus_r(); };
 
 }
 
@@ -76,14 +97,60 @@ void cpu_bus::connect_cart(Cart* cart_ptr) {
     m_cart = cart_ptr;
 }
 
+void cpu_bus::remap_cart() {
+
+    // Page 0x40 is shared with the IO registers at 0x4000 - 0x401F, so it always
+    //      goes through the address decode
+    for (int page = 0x41; page <= 0xFF; page++) {
+        m_read_pages[page]  = m_cart->cpu_read_page(page);
+        m_write_pages[page] = m_cart->cpu_write_page(page);
+
+        // Cached code is keyed by the memory it came from, so switching banks doesn't make
+        //      any of it stale. PRG RAM it came from must stay protected wherever it's mapped
+        m_code_pages[page] = nullptr;
+        if (m_write_pages[page] != nullptr && m_cpu->caches_code(m_write_pages[page]))
+            std::swap(m_code_pages[page], m_write_pages[page]);
+
+        // Only the few pages with Game Genie patches pay for them
+        if (page >= 0x80) {
+            m_cart_read_pages[page - 0x80] = m_read_pages[page];
+            if (m_gg != nullptr && m_gg->patches_page(page)) m_read_pages[page] = nullptr;
+        }
+    }
+
+}
+
+void cpu_bus::cart_changed() {
+
+    m_cpu->flush_blocks();
+    for (int page = 0x00; page <= 0xFF; page++) {
+        if (m_code_pages[page] != nullptr) std::swap(m_code_pages[page], m_write_pages[page]);
+        m_code_writes[page] = 0;
+    }
+    remap_cart();
+
+}
+
 /* Read from and write to the bus ------------------------- */
 
-void cpu_bus::WB(uint16_t addr, uint8_t value) {
+void cpu_bus::decode_WB(uint16_t addr, uint8_t value) {
 
     using namespace AddressMirrors::CpuBus;
 
+    // Writing to memory the CPU decoded code from, the code is dropped and the page goes
+    //      back to plain stores until code is decoded from it again
+    if (uint8_t* memory = m_code_pages[addr >> 8]) {
+        for (int page = 0x00; page <= 0xFF; page++)
+            if (m_code_pages[page] == memory) {
+                std::swap(m_code_pages[page], m_write_pages[page]);
+                if (m_code_writes[page] < self_modifying_writes) ++m_code_writes[page];
+            }
+        m_cpu->code_written(memory);
+        memory[addr & 0xFF] = value;
+    }
+
     // RAM - Address Range 0x0000 - 0x2000
-    if (addr >= 0x0000 && addr <= 0x1FFF) {
+    else if (addr >= 0x0000 && addr <= 0x1FFF) {
         m_ram[mirror_ram(addr)] = value;
     } 
     
@@ -93,20 +160,29 @@ void cpu_bus::WB(uint16_t addr, uint8_t value) {
         // Reduce the mirrored address to a single common address
         uint16_t reduced_addr = mirror_io(addr);
 
-        // Pull the function from the hash map and if there is a mapping
+        // PPU registers and OAM DMA see the PPU in its current state
+        if (reduced_addr < 0x4000 || reduced_addr == 0x4014) sync_ppu();
+
+        // Pull the function from the dispatch table and if there is a mapping
         //      jump to the io regsiter write function
-        void(*write_function)(cpu_bus&, uint8_t) = m_io_writes[reduced_addr];
+        void(*write_function)(cpu_bus&, uint8_t) = m_io_writes[io_index(reduced_addr)];
         if (write_function != nullptr) (*write_function)(*this, value);
+
+        // Turning rendering on or off, or swapping pattern tables, moves the mapper's IRQ
+        if (reduced_addr == 0x2000 || reduced_addr == 0x2001) schedule_ppu();
     } 
     
     // Cart - Address Range 0x4020 - 0xFFFF
     else if (addr >= 0x4020 && addr <= 0xFFFF) {
+        // Mapper registers may change mirroring or banks the PPU is reading from
+        sync_ppu();
         m_cart->cpu_WB(addr, value);
+        schedule_ppu();
     }
 
 }
 
-uint8_t cpu_bus::RB(uint16_t addr) {
+uint8_t cpu_bus::decode_RB(uint16_t addr) {
 
     using namespace AddressMirrors::CpuBus;
     std::uint8_t data = 0;
@@ -122,22 +198,54 @@ uint8_t cpu_bus::RB(uint16_t addr) {
         // Reduce the mirrored address to a single common address
         uint16_t reduced_addr = mirror_io(addr);
 
-        // Pull the function from the hash map and if there is a mapping 
+        // PPU registers see the PPU in its current state
+        if (reduced_addr < 0x4000 || reduced_addr == 0x4014) sync_ppu();
+
+        // Pull the function from the dispatch table and if there is a mapping 
         //      jump to the io register read function
-        uint8_t(*read_function)(cpu_bus&) = m_io_reads[reduced_addr];
+        uint8_t(*read_function)(cpu_bus&) = m_io_reads[io_index(reduced_addr)];
         if (read_function != nullptr) data = (*read_function)(*this);
 
     } 
     
     // Cart - Address Range 0x4020 - 0xFFFF
     else if (addr >= 0x4020 && addr <= 0xFFFF) {
-        data = m_cart->cpu_RB(addr);
+
+        // Pages patched by the Game Genie are still mapped, they are just left out of the
+        //      page table so the Game Genie gets a chance to hijack the byte read
+        const uint8_t* page = addr >= 0x8000 ? m_cart_read_pages[(addr >> 8) - 0x80] : nullptr;
+        data = page != nullptr ? page[addr & 0xFF] : m_cart->cpu_RB(addr);
+
+        if (addr >= 0x8000 && m_gg != nullptr && m_gg->patches_page(addr >> 8))
+            data = m_gg->RB(addr, data);
+    }
+
+    return data;
+}
+
+bool cpu_bus::protect_code(const uint8_t* memory) {
+
+    bool writable = false;
+    for (int page = 0x00; page <= 0xFF; page++)
+        if (m_write_pages[page] != nullptr && m_write_pages[page] == memory) {
+            std::swap(m_code_pages[page], m_write_pages[page]);
+            writable = true;
+        }
+
+    return writable;
+}
+
+void cpu_bus::ram_changed() {
+
+    for (int page = 0x00; page <= 0x1F; page++) {
+        uint8_t* memory = m_code_pages[page];
+        if (memory == nullptr) continue;
+
+        for (int alias = 0x00; alias <= 0xFF; alias++)
+            if (m_code_pages[alias] == memory) std::swap(m_code_pages[alias], m_write_pages[alias]);
+        m_cpu->code_written(memory);
     }
 
-    /* Here, the game-genie has the potential to hijack the byte read. If
-     * the byte is to be hijacked, data is updated otherwise it remains the
-     * same as it would normally. */
-    return m_gg->RB(addr, data);
 }
 
 /* External signals --------------------------------------- */
@@ -146,6 +254,10 @@ void cpu_bus::irq() {
     m_cpu->irq();
 }
 
+void cpu_bus::irq_release() {
+    m_cpu->irq_release();
+}
+
 void cpu_bus::nmi() {
     m_cpu->nmi();
 }
@@ -157,17 +269,65 @@ void cpu_bus::rst() {
             initial conditions before the entry point is fetched from the fixed address.
     */
     m_cart->rst();
+    remap_cart();
     m_cpu->rst();
 }
 
+/* Save states -------------------------------------------- */
+
+void cpu_bus::save(StateWriter& state) const {
+
+    state.section("CBUS");
+    state.bytes(m_ram.get(), 0x0800);
+    state.put(m_elapsed_clocks);
+    state.put(m_ppu_deadline);
+
+}
+
+bool cpu_bus::load(StateReader& state) {
+
+    state.section("CBUS");
+    state.bytes(m_ram.get(), 0x0800);
+    state.get(m_elapsed_clocks);
+    state.get(m_ppu_deadline);
+
+    // Code the CPU decoded from RAM is gone, so nothing needs protecting anymore. Code
+    //      decoded from ROM is still good, the cartridge is the same one
+    for (int page = 0x00; page <= 0xFF; page++) {
+        if (m_code_pages[page] != nullptr) std::swap(m_code_pages[page], m_write_pages[page]);
+        m_code_writes[page] = 0;
+    }
+    m_cpu->flush_ram_blocks();
+
+    return state.ok();
+}
+
 /* Step all components on the bus ------------------------- */
 
-void cpu_bus::step() {
+void cpu_bus::sync_ppu() {
 
-    ++m_elapsed_clocks;
-    
     // PPU is clocked at 3x speed
-    m_ppu->step(); m_ppu->step(); m_ppu->step();
+    m_ppu->run_until(m_elapsed_clocks * 3);
+    schedule_ppu();
+
+}
+
+void cpu_bus::schedule_ppu() {
+
+    // An instrumented PPU is kept in step with the CPU so its hooks see every dot as it happens
+    if (m_ppu->instrumented()) {
+        m_ppu_deadline = 0;
+        return;
+    }
+
+    // The mapper counts scanlines by watching the PPU, which is only worth catching up for the
+    //      scanline its IRQ goes off on
+    unsigned long long event = m_ppu->next_event();
+    int scanlines = m_cart->scanlines_until_irq();
+    if (scanlines > 0) event = std::min(event, m_ppu->scanline_clock(scanlines));
+
+    // Round up so the deadline is the first CPU cycle at or past the event
+    m_ppu_deadline = (event + 2) / 3;
 
 }
 
@@ -329,3 +489,41 @@ uint8_t ppu_bus::RB(uint16_t addr) {
 
     return 0x00;
 }
+
+void ppu_bus::clock_scanline() {
+    m_cart->clock_scanline();
+}
+
+const uint8_t* ppu_bus::pattern_row(uint16_t addr, bool flip) {
+
+    const uint8_t* row = m_cart->chr_row(addr, flip);
+    if (row != nullptr) return row;
+
+    // Not directly mapped, decode it through the bus the same way the cartridge would
+    uint8_t lo = RB(addr + 0), hi = RB(addr + 8);
+    for (int i = 0; i < 8; i++) {
+        int bit = flip ? i : 7 - i;
+        m_pattern_row[i] = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+    }
+    return m_pattern_row;
+
+}
+
+/* Save states -------------------------------------------- */
+
+void ppu_bus::save(StateWriter& state) const {
+
+    state.section("PBUS");
+    state.bytes(m_vram.get(), 2 * 0x0400);
+    state.bytes(m_pal.get(), 0x20);
+
+}
+
+bool ppu_bus::load(StateReader& state) {
+
+    state.section("PBUS");
+    state.bytes(m_vram.get(), 2 * 0x0400);
+    state.bytes(m_pal.get(), 0x20);
+
+    return state.ok();
+}
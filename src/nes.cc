@@ -1,15 +1,25 @@
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include "nes.hh"
+#include "simd.hh"
 
 #ifdef DEBUG
 #include "debug/debug.hh"
 #endif
 
-nes::nes() {
+nes::nes() : m_pacer(std::chrono::nanoseconds(16666667)) {
 
-    const char* name   = "DorcelessNESs - nes emulator"; // Window name
-    const int winScale = 3;  // Feel free to ajudst this to your liking
     m_running = true;
+    m_instructions = 0;
+    m_tracing = false;
+    m_rewinding = false;
+    m_capture_ns = 0;
+    m_captures = 0;
+    m_run_ahead = 0;
+    m_snapshot_ns = m_ahead_ns = m_restore_ns = 0;
+    m_shown = 0;
 
     /* Make all necessary connections between cartridge components and buslines */
 
@@ -19,6 +29,7 @@ nes::nes() {
     // Connect cartridge to busline
     m_cpu_bus.connect_cart(&m_cart);
     m_ppu_bus.connect_cart(&m_cart);
+    m_cart.connect_bus(&m_cpu_bus);
 
     m_cpu_bus.connect_cpu(&m_cpu);
     m_cpu_bus.connect_ppu(&m_ppu);
@@ -30,92 +41,326 @@ nes::nes() {
     // Connecting Game Genie to CPU bus
     m_cpu_bus.connect_game_genie(&game_genie);
 
-    /* Initialize SDL2 related stuff for rendering -------- */
+    // The debugger listens in on everything the CPU and PPU do
+    #ifdef DEBUG
+    m_cpu.attach(&Debugger::get());
+    m_ppu.attach(&Debugger::get());
+    #endif
 
-    m_window   = SDL_CreateWindow(name, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, TV_W * winScale, TV_H * winScale, SDL_WINDOW_RESIZABLE);
-    m_renderer = SDL_CreateRenderer(m_window, -1, 0);
-    m_texture  = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, TV_W, TV_H);
-    m_time     = std::chrono::high_resolution_clock::now();
 }
 
 void nes::add_cheat_code(const std::string& code) {
 
     game_genie.add_code(code);
 
+    // Take the patched page out of the page tables
+    m_cpu_bus.remap_cart();
+
+}
+
+bool nes::start_trace(const std::string& path, uint16_t lo, uint16_t hi) {
+
+    m_trace = std::make_unique<TraceWriter>(path, &m_cpu_bus, &m_ppu, lo, hi);
+    if (!m_trace->is_open()) {
+        m_trace.reset();
+        return false;
+    }
+
+    m_cpu.trace(m_trace.get());
+    m_tracing = true;
+    return true;
+
 }
 
 bool nes::load_cart(const std::string& rom_path) {
 
-   return m_cart.load_rom(rom_path);
+   if (!m_cart.load_rom(rom_path)) return false;
+   m_rom_path = rom_path;
+   m_state_path = rom_path + ".state";
+   m_layout.clear();
+   return true;
+
+}
+
+bool nes::load_cart(const uint8_t* rom, size_t size) {
+
+    // Nowhere to keep save state files
+    if (!m_cart.load_rom(rom, size)) return false;
+    m_rom_path.clear();
+    m_state_path.clear();
+    m_layout.clear();
+    return true;
+
+}
+
+void nes::reset() {
+
+    m_cpu_bus.rst();
+    m_instructions = 0;
+
+}
+
+void nes::run_frame(uint8_t buttons) {
+
+    m_cpu_bus.ram_changed();
+    m_ctrl1.set_buttons(buttons);
+    step_frame();
+
+}
+
+/* Save states -------------------------------------------- */
+
+void nes::save_state(std::vector<uint8_t>& state) {
+
+    // Saves the PPU as it would be seen, not however far it is lagging behind
+    m_cpu_bus.sync_ppu();
+
+    StateWriter writer(state);
+    m_cpu.save(writer);
+    m_cpu_bus.save(writer);
+    m_ppu.save(writer);
+    m_ppu_bus.save(writer);
+    m_cart.save(writer);
+    m_ctrl1.save(writer);
+    writer.finish();
 
 }
 
-void nes::event_poll() {
+bool nes::load_state(const std::vector<uint8_t>& state) {
 
-    const uint8_t *key_state = SDL_GetKeyboardState(nullptr);
-    m_ctrl1.update(key_state);
+    // Anything going wrong part way through would leave a mix of both states behind. Loading
+    //      only fails on a state laid out differently or from another rom, so check for those
+    //      before anything is touched
+    if (m_layout.empty()) save_state(m_layout);
+    if (!StateReader::same_layout(state, m_layout) || !m_cart.identifies(state))
+        return false;
 
-    for (SDL_Event event; SDL_PollEvent(&event);) {
-        switch (event.type) {
+    StateReader reader(state);
+    return m_cpu.load(reader) && m_cpu_bus.load(reader) && m_ppu.load(reader)
+        && m_ppu_bus.load(reader) && m_cart.load(reader) && m_ctrl1.load(reader) && reader.finish();
+}
 
-            case SDL_QUIT: 
-                m_running = false; 
-                break;
+bool nes::save_state_file() {
 
-            case SDL_KEYDOWN:
+    save_state(m_state);
 
-                #ifdef DEBUG // 'Break' stop emu, go to debugger
-                if (key_state[SDL_SCANCODE_B]) {
-                    Debugger::get().do_break();
-                }
-                #endif
+    std::ofstream file(m_state_path, std::ios::binary);
+    file.write((const char*)m_state.data(), m_state.size());
+    if (!file) {
+        std::cout << "Could not write save state: " << m_state_path << std::endl;
+        return false;
+    }
+    return true;
 
-                break;
-                
+}
+
+bool nes::load_state_file() {
 
-        }
+    std::ifstream file(m_state_path, std::ios::binary);
+    m_state.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!file.is_open() || !load_state(m_state)) {
+        std::cout << "Could not load save state: " << m_state_path << std::endl;
+        return false;
     }
+    return true;
+
+}
+
+/* Rewinding ---------------------------------------------- */
+
+void nes::enable_rewind(size_t budget) {
+
+    if (budget > 0) m_rewind = std::make_unique<Rewind>(budget);
+    else m_rewind.reset();
+
 }
 
-void nes::run() {
+void nes::capture_rewind() {
 
-    using timing = std::chrono::high_resolution_clock;
+    using timing = std::chrono::steady_clock;
     using namespace std::chrono;
 
-    const float frame_us = 16666.66667f;
-    m_cpu_bus.rst();
+    timing::time_point start = timing::now();
+    save_state(m_state);
+    m_rewind->push(m_state);
+    m_capture_ns += duration_cast<nanoseconds>(timing::now() - start).count();
+    ++m_captures;
 
-    while (m_running) {
+}
 
-        while (m_ppu.m_frameIncompete) {
+// Go back a frame and emulate it again so there is a picture to show, false once the buffer
+//      has run out. The buffer holds the state every frame started from, the newest one being
+//      the frame on screen: that one goes, and the frame before it is emulated from the state
+//      left newest, which stays on the buffer for the frame to be rewound past next time
+bool nes::step_back() {
 
-            // Execute a single instructoin
-            uint8_t cycles = m_cpu.step();
+    if (m_rewind->frames() < 2) return false;
 
-            // Catch up remaining components
-            for(; cycles > 0; cycles--) 
-                m_cpu_bus.step();
-            
-            #ifdef DEBUG
-            Debugger::get().poll();
-            #endif
+    m_rewind->pop(m_state);
+    if (!m_rewind->peek(m_state) || !load_state(m_state)) return false;
+    step_frame();
+    return true;
 
-        }
+}
+
+/* Run ahead ---------------------------------------------- */
+
+void nes::run_ahead(unsigned frames) {
+
+    m_run_ahead = frames;
+
+}
 
-        // Render frame
-        SDL_UpdateTexture(m_texture, nullptr, m_ppu.get_buf().get(), TV_W * sizeof(int));
-        SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
-        SDL_RenderPresent(m_renderer);
-        m_ppu.m_frameIncompete = true;
+// Emulate the real frame and, when running ahead, the frames after it on the same input.
+//      The frame buffer ends up holding the last of them
+void nes::advance_frame() {
 
-        // Do event poll
-        event_poll();
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    if (m_rewind) capture_rewind();
+    step_frame();
+    ++m_shown;
+    if (m_run_ahead == 0) return;
+
+    timing::time_point start = timing::now();
+    save_state(m_ahead);
+    timing::time_point saved = timing::now();
+    for (unsigned frame = 0; frame < m_run_ahead; frame++) step_frame();
+
+    m_snapshot_ns += duration_cast<nanoseconds>(saved - start).count();
+    m_ahead_ns += duration_cast<nanoseconds>(timing::now() - saved).count();
+
+}
+
+// Back to the real frame, once whatever advance_frame left in the frame buffer has been shown
+void nes::restore_ahead() {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    if (m_run_ahead == 0) return;
+
+    timing::time_point start = timing::now();
+    load_state(m_ahead);
+    m_restore_ns += duration_cast<nanoseconds>(timing::now() - start).count();
+
+}
+
+void nes::step_frame() {
+
+    while (m_ppu.m_frameIncompete) {
+
+        #ifdef DEBUG
+        // Execute a single instructoin
+        uint8_t cycles = m_cpu.step();
+        ++m_instructions;
+
+        // Catch up remaining components
+        m_cpu_bus.step(cycles);
+        
+        Debugger::get().poll();
+        #else
+        // Run up to the PPU's next event, the frame can only complete there. The CPU
+        //      steps the bus after every instruction itself
+        unsigned long long now = m_cpu_bus.m_elapsed_clocks, deadline = m_cpu_bus.m_ppu_deadline;
+        m_instructions += m_cpu.run(deadline > now ? deadline - now : 0);
+        #endif
+
+    }
+
+    m_ppu.m_frameIncompete = true;
+
+}
+
+void nes::force_per_dot(bool per_dot) {
+
+    m_ppu.m_per_dot = per_dot;
+
+}
+
+bool nes::force_dispatch(const std::string& engine) {
+
+    if (engine == "call") m_cpu.dispatch(Ricoh2A03::CALL);
+    else if (engine == "switch") m_cpu.dispatch(Ricoh2A03::SWITCH);
+    else if (engine == "goto") m_cpu.dispatch(Ricoh2A03::GOTO);
+    else return false;
+    return true;
+
+}
+
+// FNV-1a, one pixel at a time, continuing from the hash of the frames before
+static uint64_t hash_frame(uint64_t hash, const unsigned int* frame) {
+    for (int pixel = 0; pixel < TV_W * TV_H; pixel++)
+        hash = (hash ^ frame[pixel]) * 0x100000001B3ULL;
+    return hash;
+}
+
+void nes::run_headless(unsigned long long frames, bool frame_hash) {
+
+    using timing = std::chrono::steady_clock;
+    using namespace std::chrono;
+
+    m_cpu_bus.rst();
+    m_instructions = 0;
+    m_shown = 0;
+
+    // FNV-1a, one pixel at a time, over every frame in order
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    // No rendering, no event polling and no waiting, just emulate
+    timing::time_point start = timing::now();
+    for (unsigned long long i = 0; i < frames; i++) {
+        advance_frame();
+        if (frame_hash) hash = hash_frame(hash, m_ppu.get_buf());
+        restore_ahead();
+    }
+    double seconds = duration<double>(timing::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Frames:          " << frames << std::endl;
+    std::cout << "Instructions:    " << m_instructions << std::endl;
+    std::cout << "Wall time:       " << seconds << " s" << std::endl;
+    std::cout << "Frames/s:        " << frames / seconds << std::endl;
+    std::cout << "Instructions/s:  " << m_instructions / seconds << std::endl;
+    std::cout << "SIMD kernels:    " << Simd::selected() << std::endl;
+
+    if (m_trace)
+        std::cout << "Trace records:   " << m_trace->records() << " ("
+                  << m_trace->stalls() << " waits on a full buffer)" << std::endl;
+
+    if (m_rewind && m_captures)
+        std::cout << "Rewind:          " << m_rewind->frames() << " frames in "
+                  << m_rewind->bytes() / 1048576.0 << " MiB, capture "
+                  << m_capture_ns / 1000.0 / m_captures << " us/frame ("
+                  << m_capture_ns / 1e9 / seconds * 100.0 << "% of wall time)" << std::endl;
+
+    if (m_run_ahead && m_shown)
+        std::cout << "Run ahead:       " << m_run_ahead << " frames, snapshot "
+                  << m_snapshot_ns / 1000.0 / m_shown << " us + restore "
+                  << m_restore_ns / 1000.0 / m_shown << " us, frames ahead "
+                  << m_ahead_ns / 1e6 / m_shown << " ms per frame shown" << std::endl;
+
+    if (frame_hash)
+        std::cout << "Frame hash:      " << std::hex << std::setw(16) << std::setfill('0')
+                  << hash << std::dec << std::endl;
+
+}
+
+uint64_t nes::run_recorded(unsigned long long frames, const std::vector<InputEvent>& input) {
+
+    m_cpu_bus.rst();
+    m_instructions = 0;
 
-        // Wait for frame to complete in real time
-        while (duration_cast<microseconds>(timing::now() - m_time).count() < frame_us) 
-            ;
-        m_time = timing::now();
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    auto next = input.begin();
 
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        for (; next != input.end() && next->frame <= frame; ++next)
+            m_ctrl1.set_buttons(next->buttons);
+        step_frame();
+        hash = hash_frame(hash, m_ppu.get_buf());
     }
 
+    return hash;
 }
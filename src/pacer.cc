@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <thread>
+#include "pacer.hh"
+
+#ifdef __linux__
+#include <cerrno>
+#include <ctime>
+#endif
+
+using namespace std::chrono;
+
+// Bounds on the spin margin, sleeps are never trusted closer than the minimum
+static const nanoseconds min_margin = microseconds(100);
+static const nanoseconds max_margin = milliseconds(2);
+
+FramePacer::FramePacer(nanoseconds period) :
+    m_period(period), m_margin(milliseconds(1)),
+    m_frames(0), m_missed(0), m_slept(0), m_spun(0) {
+
+    start();
+
+}
+
+void FramePacer::start() {
+
+    m_deadline = clock::now() + m_period;
+
+}
+
+void FramePacer::sleep_until(clock::time_point when) {
+
+    #ifdef __linux__
+    // steady_clock is CLOCK_MONOTONIC, an absolute sleep can't oversleep because of a signal
+    //      coming in part way through and having to work out how much is left
+    nanoseconds since_epoch = when.time_since_epoch();
+    timespec until = { (time_t)duration_cast<seconds>(since_epoch).count(), (long)(since_epoch % seconds(1)).count() };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR)
+        ;
+    #else
+    std::this_thread::sleep_until(when);
+    #endif
+
+}
+
+void FramePacer::wait() {
+
+    clock::time_point now = clock::now();
+    ++m_frames;
+
+    // Too far behind to make up for, just carry on from here
+    if (now > m_deadline + m_period) {
+        ++m_missed;
+        m_deadline = now + m_period;
+        return;
+    }
+
+    // Sleep for most of it, then follow up on how late the sleep woke up. A late wake up
+    //      widens the margin straight away, it only narrows again slowly
+    clock::time_point wake = m_deadline - m_margin;
+    if (now < wake) {
+        sleep_until(wake);
+        clock::time_point woke = clock::now();
+        m_slept += woke - now;
+        now = woke;
+
+        nanoseconds late = duration_cast<nanoseconds>(woke - wake);
+        m_margin = std::max(late + min_margin, m_margin - m_margin / 16);
+        m_margin = std::min(std::max(m_margin, min_margin), max_margin);
+    }
+
+    // The last stretch is spun, a sleep wouldn't wake up in time
+    clock::time_point spin = now;
+    while (now < m_deadline) now = clock::now();
+    m_spun += now - spin;
+
+    m_deadline += m_period;
+
+}
@@ -0,0 +1,67 @@
+#include <thread>
+#include "pool.hh"
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : m_threads(threads > 0 ? threads : 1), m_stolen(0) {
+
+    for (unsigned worker = 0; worker < m_threads; worker++)
+        m_queues.push_back(std::make_unique<Queue>());
+
+}
+
+void WorkStealingPool::run(std::vector<Task>& tasks) {
+
+    // Deal the tasks out, nothing else is running yet so there is no need to lock
+    for (size_t task = 0; task < tasks.size(); task++)
+        m_queues[task % m_threads]->tasks.push_back(&tasks[task]);
+    m_stolen = 0;
+
+    std::vector<std::thread> workers;
+    for (unsigned worker = 1; worker < m_threads; worker++)
+        workers.emplace_back(&WorkStealingPool::work, this, worker);
+    work(0);
+
+    for (std::thread& worker : workers) worker.join();
+
+}
+
+void WorkStealingPool::work(unsigned worker) {
+
+    bool stolen;
+
+    // Queues only ever shrink, so once there is nothing left to take anywhere the batch is
+    //      done as far as this worker is concerned
+    while (Task* task = take(worker, stolen)) {
+        (*task)();
+        if (stolen) m_stolen.fetch_add(1, std::memory_order_relaxed);
+    }
+
+}
+
+WorkStealingPool::Task* WorkStealingPool::take(unsigned worker, bool& stolen) {
+
+    // Own queue first, in the order the tasks were dealt
+    {
+        Queue& own = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        stolen = false;
+        if (!own.tasks.empty()) {
+            Task* task = own.tasks.front();
+            own.tasks.pop_front();
+            return task;
+        }
+    }
+
+    // Then the last task of whichever worker comes next, the one it would get to last
+    for (unsigned offset = 1; offset < m_threads; offset++) {
+        Queue& victim = *m_queues[(worker + offset) % m_threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        stolen = true;
+        if (!victim.tasks.empty()) {
+            Task* task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,119 @@
+#include <cstring>
+#include "rewind.hh"
+
+Rewind::Rewind(size_t budget) : m_budget(budget), m_used(0) {}
+
+void Rewind::clear() {
+
+    m_newest.clear();
+    m_deltas.clear();
+    m_used = 0;
+
+}
+
+/* Adding and removing states ----------------------------- */
+
+void Rewind::push(const std::vector<uint8_t>& state) {
+
+    // States of a different size can't be diffed against, start over
+    if (m_newest.size() != state.size()) {
+        clear();
+        m_newest = state;
+        return;
+    }
+
+    std::vector<uint8_t> delta;
+    delta.swap(m_spare);
+    encode(m_newest, state, delta);
+
+    m_used += delta.size();
+    m_deltas.push_back(std::move(delta));
+    m_newest = state;
+
+    // Make room by forgetting the oldest frames
+    while (m_used > m_budget && !m_deltas.empty()) {
+        m_used -= m_deltas.front().size();
+        m_spare.swap(m_deltas.front());
+        m_deltas.pop_front();
+    }
+
+}
+
+bool Rewind::pop(std::vector<uint8_t>& state) {
+
+    if (m_newest.empty()) return false;
+    state = m_newest;
+
+    // The state before it becomes the newest
+    if (m_deltas.empty()) m_newest.clear();
+    else {
+        apply(m_newest, m_deltas.back());
+        m_used -= m_deltas.back().size();
+        m_spare.swap(m_deltas.back());
+        m_deltas.pop_back();
+    }
+
+    return true;
+}
+
+bool Rewind::peek(std::vector<uint8_t>& state) const {
+
+    if (m_newest.empty()) return false;
+    state = m_newest;
+    return true;
+}
+
+/* Encoding differences ----------------------------------- */
+
+static void put_count(std::vector<uint8_t>& out, size_t count) {
+    for (; count >= 0x80; count >>= 7) out.push_back((count & 0x7F) | 0x80);
+    out.push_back(count);
+}
+
+static size_t get_count(const uint8_t*& in) {
+    size_t count = 0;
+    for (int shift = 0; ; shift += 7) {
+        count |= (size_t)(*in & 0x7F) << shift;
+        if ((*in++ & 0x80) == 0) return count;
+    }
+}
+
+void Rewind::encode(const std::vector<uint8_t>& older, const std::vector<uint8_t>& newer, std::vector<uint8_t>& delta) {
+
+    const uint8_t* a = older.data();
+    const uint8_t* b = newer.data();
+    const size_t size = older.size();
+
+    delta.clear();
+
+    for (size_t i = 0; i < size; ) {
+
+        // Skip unchanged bytes, eight at a time where possible
+        size_t start = i;
+        for (uint64_t wa, wb; i + 8 <= size; i += 8) {
+            std::memcpy(&wa, a + i, 8); std::memcpy(&wb, b + i, 8);
+            if (wa != wb) break;
+        }
+        while (i < size && a[i] == b[i]) i++;
+        put_count(delta, i - start);
+
+        // Then the changed bytes up to the next unchanged one
+        start = i;
+        while (i < size && a[i] != b[i]) i++;
+        put_count(delta, i - start);
+        for (size_t j = start; j < i; j++) delta.push_back(a[j] ^ b[j]);
+    }
+
+}
+
+void Rewind::apply(std::vector<uint8_t>& state, const std::vector<uint8_t>& delta) {
+
+    const uint8_t* in = delta.data();
+    const uint8_t* end = delta.data() + delta.size();
+
+    for (size_t i = 0; in < end; ) {
+        i += get_count(in);
+        for (size_t changed = get_count(in); changed > 0; changed--) state[i++] ^= *in++;
+    }
+
+}
@@ -0,0 +1,110 @@
+#include <chrono>
+#include <iostream>
+#include "sdl/present.hh"
+
+/* Triple buffer ------------------------------------------ */
+
+TripleBuffer::TripleBuffer() :
+    m_middle(1), m_back(0), m_front(2),
+    m_published(0), m_dropped(0), m_duplicated(0) {
+
+    for (auto& buffer : m_buffers) buffer = std::make_unique<unsigned int[]>(frame_buf_size);
+
+}
+
+unsigned int* TripleBuffer::publish() {
+
+    // Release so the pixels are visible to whoever acquires the buffer
+    int previous = m_middle.exchange(m_back | fresh_bit, std::memory_order_acq_rel);
+    if (previous & fresh_bit) m_dropped.fetch_add(1, std::memory_order_relaxed);
+    m_published.fetch_add(1, std::memory_order_relaxed);
+
+    m_back = previous & ~fresh_bit;
+    return m_buffers[m_back].get();
+
+}
+
+const unsigned int* TripleBuffer::acquire(bool& fresh) {
+
+    // Only this side clears the fresh bit, so once it's seen set it stays set until the exchange
+    fresh = this->fresh();
+    if (fresh) m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~fresh_bit;
+    else if (m_published.load(std::memory_order_relaxed) > 0) m_duplicated.fetch_add(1, std::memory_order_relaxed);
+
+    return m_buffers[m_front].get();
+
+}
+
+/* Presentation thread ------------------------------------ */
+
+Presenter::Presenter(SDL_Window* window, bool vsync) :
+    m_window(window), m_vsync(vsync), m_done(false) {
+
+    m_thread = std::thread(&Presenter::present, this);
+
+}
+
+Presenter::~Presenter() {
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done.store(true, std::memory_order_release);
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+}
+
+unsigned int* Presenter::publish() {
+
+    unsigned int* back = m_frames.publish();
+
+    // The presentation thread only holds the lock while checking for a fresh frame, taking it
+    //      here means the wake up can't slip in between that check and it going to sleep
+    if (!m_vsync.load(std::memory_order_relaxed)) {
+        { std::lock_guard<std::mutex> lock(m_mutex); }
+        m_wake.notify_one();
+    }
+    return back;
+
+}
+
+void Presenter::present() {
+
+    SDL_Renderer* renderer = SDL_CreateRenderer(m_window, -1, m_vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    SDL_Texture*  texture  = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, TV_W, TV_H);
+
+    using timing = std::chrono::steady_clock;
+    timing::time_point last = timing::now();
+    int quick_presents = 0;
+
+    while (!m_done.load(std::memory_order_acquire)) {
+
+        // Presenting blocks until the next refresh with vsync, without it there is nothing
+        //      to do until a frame comes in
+        if (!m_vsync.load(std::memory_order_relaxed)) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_frames.fresh() || m_done.load(std::memory_order_acquire); });
+            if (m_done.load(std::memory_order_acquire)) break;
+        }
+
+        bool fresh;
+        const unsigned int* frame = m_frames.acquire(fresh);
+        if (fresh) SDL_UpdateTexture(texture, nullptr, frame, TV_W * sizeof(int));
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+
+        // No display refreshes that fast, so it didn't wait
+        timing::time_point now = timing::now();
+        quick_presents = now - last < std::chrono::milliseconds(1) ? quick_presents + 1 : 0;
+        last = now;
+        if (m_vsync.load(std::memory_order_relaxed) && quick_presents == 8) {
+            std::cout << "Presenting doesn't wait for vsync, presenting frames as they come in instead" << std::endl;
+            m_vsync.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+
+}
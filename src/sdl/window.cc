@@ -0,0 +1,114 @@
+#include <SDL2/SDL.h>
+#include <iostream>
+#include "nes.hh"
+#include "sdl/present.hh"
+
+#ifdef DEBUG
+#include "debug/debug.hh"
+#endif
+
+/*
+    The SDL front end, the window, keyboard and the loop that runs the emulator in real time. Nothing
+    else depends on SDL, the core builds without it (see nescore.h).
+*/
+
+// I'm sorry, I can't resist, cursed macros are just so much fun
+#define LIST_BUTTONS(X) \
+    /*name,     SDL scancode,      index*/ \
+    X("up",     SDL_SCANCODE_W,         4) \
+    X("left",   SDL_SCANCODE_A,         6) \
+    X("down",   SDL_SCANCODE_S,         5) \
+    X("right",  SDL_SCANCODE_D,         7) \
+    X("start",  SDL_SCANCODE_ESCAPE,    2) \
+    X("select", SDL_SCANCODE_BACKSPACE, 3) \
+    X("A",      SDL_SCANCODE_L,         0) \
+    X("B",      SDL_SCANCODE_J,         1)
+
+// Buttons held down on the keyboard, as a mask for Controller::set_buttons
+static uint8_t keyboard_buttons(const uint8_t* key_state) {
+    uint8_t buttons = 0;
+    #define X(name, scancode, index) \
+        if (key_state[scancode]) buttons |= 1 << index;
+    LIST_BUTTONS(X)
+    #undef X
+    return buttons;
+}
+
+void nes::event_poll() {
+
+    const uint8_t *key_state = SDL_GetKeyboardState(nullptr);
+    m_ctrl1.set_buttons(keyboard_buttons(key_state));
+    m_rewinding = m_rewind && key_state[SDL_SCANCODE_R];
+
+    for (SDL_Event event; SDL_PollEvent(&event);) {
+        switch (event.type) {
+
+            case SDL_QUIT: 
+                m_running = false; 
+                break;
+
+            case SDL_KEYDOWN:
+
+                #ifdef DEBUG // 'Break' stop emu, go to debugger
+                if (key_state[SDL_SCANCODE_B]) {
+                    Debugger::get().do_break();
+                }
+                #endif
+
+                // Save and load the machine
+                if (key_state[SDL_SCANCODE_F5]) save_state_file();
+                if (key_state[SDL_SCANCODE_F7]) load_state_file();
+
+                // Pause or resume tracing, if a trace was started
+                if (key_state[SDL_SCANCODE_T] && m_trace) {
+                    m_tracing = !m_tracing;
+                    m_cpu.trace(m_tracing ? m_trace.get() : nullptr);
+                }
+
+                break;
+                
+
+        }
+    }
+}
+
+void nes::run(bool vsync) {
+
+    const char* name   = "DorcelessNESs - nes emulator"; // Window name
+    const int winScale = 3;  // Feel free to ajudst this to your liking
+
+    SDL_Window* window = SDL_CreateWindow(name, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, TV_W * winScale, TV_H * winScale, SDL_WINDOW_RESIZABLE);
+    Presenter presenter(window, vsync);
+    m_ppu.set_buf(presenter.frames().back());
+
+    m_cpu_bus.rst();
+    m_pacer.start();
+
+    while (m_running) {
+
+        // Run backwards while R is held, for as long as there are frames to go back to
+        bool ahead = !m_rewinding || !step_back();
+        if (ahead) advance_frame();
+
+        // Hand the frame over to be rendered, and draw the next one somewhere else
+        m_ppu.set_buf(presenter.publish());
+
+        // The input for the next frame applies to the real one, not the one shown
+        if (ahead) restore_ahead();
+
+        // Do event poll
+        event_poll();
+
+        // Wait for frame to complete in real time
+        m_pacer.wait();
+
+    }
+
+    // The presenter's buffers go with it
+    m_ppu.set_buf(nullptr);
+
+    TripleBuffer& frames = presenter.frames();
+    std::cout << "Frames published: " << frames.published() << " (" << frames.dropped() << " dropped, "
+              << frames.duplicated() << " shown twice)" << std::endl;
+
+}
@@ -0,0 +1,129 @@
+#include "simd.hh"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* Portable versions -------------------------------------- */
+
+static void composite_sprite_scalar(unsigned int* line, const unsigned int* row, uint8_t draw, bool behind_bg) {
+    for (int i = 0; i < 8; i++)
+        if (((draw >> i) & 1) && !(behind_bg && (line[i] & 0x01000000)))
+            line[i] = row[i];
+}
+
+static void resolve_line_scalar(unsigned int* out, const uint8_t* indices, const unsigned int* lut, int count) {
+    for (int i = 0; i < count; i++)
+        out[i] = lut[indices[i]];
+}
+
+#if defined(__x86_64__)
+
+/* SSE2, always available on x86-64 ----------------------- */
+
+static void composite_sprite_sse2(unsigned int* line, const unsigned int* row, uint8_t draw, bool behind_bg) {
+
+    const __m128i bits_lo = _mm_set_epi32(0x08, 0x04, 0x02, 0x01);
+    const __m128i bits_hi = _mm_set_epi32(0x80, 0x40, 0x20, 0x10);
+    const __m128i draw_v  = _mm_set1_epi32(draw);
+    const __m128i bg_bit  = _mm_set1_epi32(0x01000000);
+    const __m128i behind  = _mm_set1_epi32(behind_bg ? -1 : 0);
+
+    __m128i dst[2] = { _mm_loadu_si128((const __m128i*)(line + 0)), _mm_loadu_si128((const __m128i*)(line + 4)) };
+    __m128i src[2] = { _mm_loadu_si128((const __m128i*)(row  + 0)), _mm_loadu_si128((const __m128i*)(row  + 4)) };
+    __m128i bits[2] = { bits_lo, bits_hi };
+
+    for (int half = 0; half < 2; half++) {
+        // Lanes whose draw bit is set, minus the ones hidden by the background
+        __m128i mask   = _mm_cmpeq_epi32(_mm_and_si128(draw_v, bits[half]), bits[half]);
+        __m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(dst[half], bg_bit), bg_bit);
+        mask = _mm_andnot_si128(_mm_and_si128(behind, opaque), mask);
+        dst[half] = _mm_or_si128(_mm_and_si128(mask, src[half]), _mm_andnot_si128(mask, dst[half]));
+    }
+
+    _mm_storeu_si128((__m128i*)(line + 0), dst[0]);
+    _mm_storeu_si128((__m128i*)(line + 4), dst[1]);
+}
+
+/* AVX2, checked for at runtime --------------------------- */
+
+__attribute__((target("avx2")))
+static void composite_sprite_avx2(unsigned int* line, const unsigned int* row, uint8_t draw, bool behind_bg) {
+
+    const __m256i bits   = _mm256_set_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i bg_bit = _mm256_set1_epi32(0x01000000);
+    const __m256i behind = _mm256_set1_epi32(behind_bg ? -1 : 0);
+
+    __m256i dst = _mm256_loadu_si256((const __m256i*)line);
+    __m256i src = _mm256_loadu_si256((const __m256i*)row);
+
+    // Lanes whose draw bit is set, minus the ones hidden by the background
+    __m256i mask   = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(draw), bits), bits);
+    __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(dst, bg_bit), bg_bit);
+    mask = _mm256_andnot_si256(_mm256_and_si256(behind, opaque), mask);
+
+    _mm256_storeu_si256((__m256i*)line, _mm256_blendv_epi8(dst, src, mask));
+}
+
+__attribute__((target("avx2")))
+static void resolve_line_avx2(unsigned int* out, const uint8_t* indices, const unsigned int* lut, int count) {
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_i32gather_epi32((const int*)lut, index, 4));
+    }
+    for (; i < count; i++)
+        out[i] = lut[indices[i]];
+}
+
+#endif
+
+/* Kernel selection --------------------------------------- */
+
+static bool has_avx2() {
+#if defined(__x86_64__)
+    // May run before main through the initializers below, so the cpu model has to be set up first
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+namespace Simd {
+
+    void (*composite_sprite)(unsigned int*, const unsigned int*, uint8_t, bool) = composite_sprite_scalar;
+    void (*resolve_line)(unsigned int*, const uint8_t*, const unsigned int*, int) = resolve_line_scalar;
+
+    static std::string g_selected = "scalar";
+
+    // Start out with the best the host has to offer
+    [[maybe_unused]] static bool g_use_best = use(has_avx2() ? "avx2" : "sse2");
+
+    bool use(const std::string& isa) {
+
+        if (isa == "scalar") {
+            composite_sprite = composite_sprite_scalar;
+            resolve_line     = resolve_line_scalar;
+        }
+#if defined(__x86_64__)
+        else if (isa == "sse2") {
+            // There is no gather before AVX2, the scalar loop is as good as it gets
+            composite_sprite = composite_sprite_sse2;
+            resolve_line     = resolve_line_scalar;
+        }
+        else if (isa == "avx2" && has_avx2()) {
+            composite_sprite = composite_sprite_avx2;
+            resolve_line     = resolve_line_avx2;
+        }
+#endif
+        else return false;
+
+        g_selected = isa;
+        return true;
+    }
+
+    const std::string& selected() { return g_selected; }
+
+}
@@ -0,0 +1,136 @@
+#include <cstring>
+#include "state.hh"
+
+static const char state_magic[8] = { 'N', 'E', 'S', 'S', 'T', 'A', 'T', 'E' };
+
+/* Writing ------------------------------------------------ */
+
+StateWriter::StateWriter(std::vector<uint8_t>& data) : m_data(data), m_section(0) {
+
+    m_data.clear();
+    bytes(state_magic, sizeof(state_magic));
+    bytes(&state_version, sizeof(state_version));
+
+}
+
+void StateWriter::close_section() {
+
+    if (m_section == 0) return;
+
+    uint32_t size = m_data.size() - m_section - sizeof(uint32_t);
+    std::memcpy(&m_data[m_section], &size, sizeof(size));
+    m_section = 0;
+
+}
+
+void StateWriter::section(const char* tag) {
+
+    close_section();
+    bytes(tag, 4);
+
+    // The size is filled in once the section is closed
+    m_section = m_data.size();
+    put<uint32_t>(0);
+
+}
+
+void StateWriter::finish() {
+    close_section();
+}
+
+void StateWriter::bytes(const void* data, size_t size) {
+
+    // Empty memory (CHR RAM on carts with CHR ROM) may not have anywhere to copy from
+    if (size == 0) return;
+
+    size_t at = m_data.size();
+    m_data.resize(at + size);
+    std::memcpy(&m_data[at], data, size);
+
+}
+
+/* Reading ------------------------------------------------ */
+
+StateReader::StateReader(const std::vector<uint8_t>& data) {
+
+    m_pos = data.data();
+    m_end = m_section_end = data.data() + data.size();
+    m_version = 0;
+    m_ok = true;
+
+    char magic[sizeof(state_magic)];
+    m_ok = bytes(magic, sizeof(magic)) && std::memcmp(magic, state_magic, sizeof(magic)) == 0
+        && get(m_version) && m_version == state_version;
+
+    // Nothing outside of a section belongs to a component
+    m_section_end = m_pos;
+
+}
+
+bool StateReader::section(const char* tag) {
+
+    if (!m_ok || m_pos != m_section_end) return m_ok = false;
+    m_section_end = m_end;
+
+    char found[4];
+    uint32_t size;
+    if (!bytes(found, 4) || std::memcmp(found, tag, 4) != 0 || !get(size) || size > (size_t)(m_end - m_pos))
+        return m_ok = false;
+
+    m_section_end = m_pos + size;
+    return true;
+
+}
+
+bool StateReader::finish() {
+    return m_ok = m_ok && m_pos == m_section_end && m_pos == m_end;
+}
+
+bool StateReader::find(const char* tag) {
+
+    char found[4];
+    uint32_t size;
+    while (m_ok) {
+
+        // Leave whatever is left of the section being read
+        m_pos = m_section_end;
+        m_section_end = m_end;
+        if (!bytes(found, 4) || !get(size) || size > (size_t)(m_end - m_pos)) return m_ok = false;
+
+        m_section_end = m_pos + size;
+        if (std::memcmp(found, tag, 4) == 0) return true;
+    }
+    return false;
+
+}
+
+bool StateReader::same_layout(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+
+    StateReader ra(a), rb(b);
+    if (!ra.ok() || !rb.ok()) return false;
+
+    // Section headers are the tag followed by the size, both compared in one go
+    uint8_t ha[8], hb[8];
+    while (ra.m_pos != ra.m_end || rb.m_pos != rb.m_end) {
+        ra.m_section_end = ra.m_end; rb.m_section_end = rb.m_end;
+        if (!ra.bytes(ha, 8) || !rb.bytes(hb, 8) || std::memcmp(ha, hb, 8) != 0) return false;
+
+        uint32_t size;
+        std::memcpy(&size, ha + 4, sizeof(size));
+        if (size > (size_t)(ra.m_end - ra.m_pos) || size > (size_t)(rb.m_end - rb.m_pos)) return false;
+        ra.m_pos += size; rb.m_pos += size;
+    }
+    return true;
+
+}
+
+bool StateReader::bytes(void* data, size_t size) {
+
+    if (!m_ok || size > (size_t)(m_section_end - m_pos)) return m_ok = false;
+    if (size == 0) return true;
+
+    std::memcpy(data, m_pos, size);
+    m_pos += size;
+    return true;
+
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "trace.hh"
+#include "memory.hh"
+#include "2C02.hh"
+
+TraceWriter::TraceWriter(const std::string& path, cpu_bus* bus, Ricoh2C02* ppu, uint16_t lo, uint16_t hi) :
+    m_ring(std::make_unique<TraceRecord[]>(ring_size)),
+    m_head(0), m_tail(0), m_done(false),
+    m_stalls(0),
+    m_bus(bus), m_ppu(ppu), m_lo(lo), m_hi(hi) {
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        std::cout << "Trace file could not be opened" << std::endl;
+        return;
+    }
+
+    // Header, the reader uses the record size to stay compatible with larger records
+    const uint32_t version = 1, record_size = sizeof(TraceRecord);
+    std::fwrite("NESTRACE", 1, 8, m_file);
+    std::fwrite(&version, sizeof(version), 1, m_file);
+    std::fwrite(&record_size, sizeof(record_size), 1, m_file);
+
+    m_thread = std::thread(&TraceWriter::drain, this);
+}
+
+TraceWriter::~TraceWriter() {
+
+    if (m_file == nullptr) return;
+
+    m_done.store(true, std::memory_order_release);
+    m_thread.join();
+    std::fclose(m_file);
+
+}
+
+/* Emulation thread --------------------------------------- */
+
+void TraceWriter::cpu_instruction(const CpuContext& ctx) {
+
+    if (ctx.reg_pc < m_lo || ctx.reg_pc > m_hi || m_file == nullptr) return;
+
+    // Never drop records, a trace with holes in it is useless. Wait for the writer instead
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == ring_size) {
+        ++m_stalls;
+        while (head - m_tail.load(std::memory_order_acquire) == ring_size)
+            std::this_thread::yield();
+    }
+
+    TraceRecord& r = m_ring[head & (ring_size - 1)];
+    r.cycle = ctx.cycle;
+    r.pc    = ctx.reg_pc;
+    r.a = ctx.reg_a; r.x = ctx.reg_x; r.y = ctx.reg_y;
+    r.p = ctx.reg_p; r.s = ctx.reg_s;
+
+    int scanline, dot;
+    m_ppu->position_at(ctx.cycle * 3, scanline, dot);
+    r.scanline = scanline;
+    r.dot      = dot;
+
+    for (int i = 0; i < 3; i++) r.bytes[i] = m_bus->peek(ctx.reg_pc + i);
+    r.reserved[0] = r.reserved[1] = 0;
+
+    m_head.store(head + 1, std::memory_order_release);
+
+}
+
+/* Writer thread ------------------------------------------ */
+
+void TraceWriter::drain() {
+
+    for (;;) {
+
+        // Read done before head, so nothing pushed before finishing is missed
+        bool done   = m_done.load(std::memory_order_acquire);
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (head == tail) {
+            if (done) return;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        // Write out everything up to the end of the ring in one go, the wrapped part is picked
+        //      up on the next pass
+        size_t start = tail & (ring_size - 1);
+        size_t count = std::min(head - tail, ring_size - start);
+        std::fwrite(&m_ring[start], sizeof(TraceRecord), count, m_file);
+
+        m_tail.store(tail + count, std::memory_order_release);
+    }
+
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+
+'''
+    Drives libnescore (see include/nescore.h) in process through ctypes, and doubles as an example of how
+    to. Runs a rom for a number of frames holding no buttons, checks that loading a save state taken part
+    way through gives back the same frames, and prints how fast it all went. Then checks that images which
+    can't be loaded leave the machine running the rom it had.
+
+    Usage: nescore.py <path to libnescore.so> <rom> [frames]
+'''
+
+import ctypes
+import hashlib
+from sys import argv
+from time import perf_counter
+
+WIDTH, HEIGHT = 256, 240
+A, B, SELECT, START, UP, DOWN, LEFT, RIGHT = (1 << bit for bit in range(8))
+
+class NesCore:
+
+    def __init__(self, library, rom):
+        self.lib = ctypes.CDLL(library)
+        self.lib.nescore_create.restype = ctypes.c_void_p
+        self.lib.nescore_destroy.argtypes = [ctypes.c_void_p]
+        self.lib.nescore_load_rom.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        self.lib.nescore_step_frame.argtypes = [ctypes.c_void_p, ctypes.c_uint8]
+        self.lib.nescore_framebuffer.argtypes = [ctypes.c_void_p]
+        self.lib.nescore_framebuffer.restype = ctypes.POINTER(ctypes.c_uint8)
+        self.lib.nescore_ram.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)]
+        self.lib.nescore_ram.restype = ctypes.POINTER(ctypes.c_uint8)
+        self.lib.nescore_save_state.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+        self.lib.nescore_save_state.restype = ctypes.c_size_t
+        self.lib.nescore_load_state.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+
+        self.core = self.lib.nescore_create()
+        with open(rom, "rb") as image:
+            self.image = image.read()
+        if not self.load_rom(self.image):
+            raise RuntimeError("unsupported rom: " + rom)
+
+        # Both point into the machine, so they only have to be looked up once
+        size = ctypes.c_size_t()
+        self.ram = self.lib.nescore_ram(self.core, ctypes.byref(size))
+        self.ram_size = size.value
+
+    def __del__(self):
+        self.lib.nescore_destroy(self.core)
+
+    # The image is copied, the buffer passed in can go as soon as this returns
+    def load_rom(self, data):
+        image = ctypes.create_string_buffer(data, len(data))
+        loaded = self.lib.nescore_load_rom(self.core, image, len(data)) == 1
+        ctypes.memset(image, 0xFF, len(data))
+        return loaded
+
+    def step(self, buttons = 0):
+        self.lib.nescore_step_frame(self.core, buttons)
+
+    # RGBA, a row at a time
+    def frame(self):
+        return ctypes.string_at(self.lib.nescore_framebuffer(self.core), WIDTH * HEIGHT * 4)
+
+    def save_state(self):
+        state = ctypes.create_string_buffer(self.lib.nescore_save_state(self.core, None, 0))
+        self.lib.nescore_save_state(self.core, state, len(state))
+        return state.raw
+
+    def load_state(self, state):
+        return self.lib.nescore_load_state(self.core, state, len(state)) == 1
+
+# Images that fail to load, a header cut short and an unsupported mapper (5, MMC5), have to be turned
+#   down without touching the rom already in the machine, which then plays on exactly as it would have
+def check_failed_loads(core, frames):
+
+    state = core.save_state()
+    expected = hashlib.sha1()
+    for _ in range(frames):
+        core.step()
+        expected.update(core.frame())
+
+    core.load_state(state)
+    mmc5 = bytearray(core.image)
+    mmc5[6] = (mmc5[6] & 0x0F) | 0x50
+    mmc5[7] = mmc5[7] & 0x0F
+    rejected = not core.load_rom(core.image[:8]) and not core.load_rom(bytes(mmc5))
+
+    played = hashlib.sha1()
+    for _ in range(frames):
+        core.step()
+        played.update(core.frame())
+
+    # A machine that never had a rom doesn't run at all
+    empty = core.lib.nescore_create()
+    core.lib.nescore_step_frame(empty, 0)
+    core.lib.nescore_destroy(empty)
+
+    return rejected and expected.digest() == played.digest() and core.load_state(state)
+
+def main():
+
+    core = NesCore(argv[1], argv[2])
+    frames = int(argv[3]) if len(argv) > 3 else 600
+
+    start = perf_counter()
+    for _ in range(frames // 2): core.step()
+    state = core.save_state()
+    digest = hashlib.sha1()
+    for _ in range(frames - frames // 2):
+        core.step()
+        digest.update(core.frame())
+    seconds = perf_counter() - start
+
+    core.load_state(state)
+    replayed = hashlib.sha1()
+    for _ in range(frames - frames // 2):
+        core.step()
+        replayed.update(core.frame())
+
+    print("Frames:     %d in %.3f s, %.1f frames/s" % (frames, seconds, frames / seconds))
+    print("State:      %d bytes, replay %s" % (len(state), "identical" if digest.digest() == replayed.digest() else "DIFFERENT"))
+    print("RAM $0000:  " + " ".join("%02X" % core.ram[i] for i in range(16)))
+    print("Bad roms:   " + ("rejected, machine unaffected" if check_failed_loads(core, 60) else "FAILED"))
+
+if __name__ == "__main__": main()
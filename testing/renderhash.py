@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+
+'''
+    Runs a rom headless twice, once with the scanline renderer and once forcing the old per dot renderer, and compares
+        the frame hashes the emulator prints. Both should be identical, if they aren't something in the scanline renderer
+        has drifted from fetch_bg_pixel.
+
+    Usage: ./testing/renderhash.py ./nes path/to/rom.nes [frames]
+'''
+
+from sys import argv, exit # for command line arguments
+import subprocess
+
+def frame_hash(emulator, rom, frames, *extra):
+    output = subprocess.run([emulator, rom, "--frame-hash", "--frames", frames, *extra],
+                            capture_output=True, text=True).stdout
+    for line in output.splitlines():
+        if line.startswith("Frame hash:"):
+            return line.split()[-1]
+    return None
+
+frames = argv[3] if len(argv) > 3 else "600"
+
+scanline = frame_hash(argv[1], argv[2], frames)
+per_dot  = frame_hash(argv[1], argv[2], frames, "--per-dot")
+
+print("Scanline renderer: " + str(scanline))
+print("Per dot renderer:  " + str(per_dot))
+
+if scanline is None or scanline != per_dot:
+    print("MISMATCH")
+    exit(1)
+print("OK")
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+
+'''
+Generates entries for the rom database (romdb.txt, see include/cart/romdb.hh), printing them so they
+    can be appended to it. Takes either the NES 2.0 XML database (nes20db.xml, which covers most of
+    the commercial library) or roms whose NES 2.0 headers are known to be right:
+
+    ./testing/romdb.py ~/Downloads/nes20db.xml >> romdb.txt
+    ./testing/romdb.py ~/Documents/Roms/nes/*.nes >> romdb.txt
+
+The key is the CRC32 of everything after the header and trainer, which is what the emulator hashes.
+'''
+
+from sys import argv, stderr
+from zlib import crc32
+import xml.etree.ElementTree as ElementTree
+
+REGIONS = 'NPMD'
+
+def entry(crc, prg_rom, chr_rom, mapper, submapper, mirroring, prg_ram, prg_nvram, chr_ram, chr_nvram, region):
+    return '%08x %d %d %d %d %s %d %d %d %d %s' % (crc, prg_rom, chr_rom, mapper, submapper, mirroring,
+        prg_ram, prg_nvram, chr_ram, chr_nvram, REGIONS[region & 3])
+
+def from_xml(path):
+
+    def size(game, tag):
+        node = game.find(tag)
+        return int(node.get('size', 0)) if node is not None else 0
+
+    for game in ElementTree.parse(path).getroot().iter('game'):
+
+        rom, pcb = game.find('rom'), game.find('pcb')
+        if rom is None or pcb is None or rom.get('crc32') is None:
+            continue
+
+        # Anything other than vertical or four screen is soldered horizontal or up to the mapper
+        mirroring = pcb.get('mirroring', 'H')
+        if mirroring not in ('H', 'V', '4'): mirroring = 'H'
+
+        console = game.find('console')
+        region = int(console.get('region', 0)) if console is not None else 0
+
+        print(entry(int(rom.get('crc32'), 16), size(game, 'prgrom'), size(game, 'chrrom'),
+            int(pcb.get('mapper', 0)), int(pcb.get('submapper', 0)), mirroring,
+            size(game, 'prgram'), size(game, 'prgnvram'), size(game, 'chrram'), size(game, 'chrnvram'), region))
+
+def from_rom(path):
+
+    with open(path, 'rb') as rom:
+        data = rom.read()
+
+    header = data[0:16]
+    if header[0:4] != b'NES\x1a' or (header[7] & 0x0C) != 0x08:
+        print('%s: not a NES 2.0 rom, skipped' % path, file=stderr)
+        return
+
+    def rom_size(lsb, msb, unit):
+        return ((msb << 8) | lsb) * unit if msb != 0xF else (1 << (lsb >> 2)) * ((lsb & 3) * 2 + 1)
+
+    def ram_size(shift):
+        return 64 << shift if shift else 0
+
+    mirroring = '4' if header[6] & 0x08 else 'V' if header[6] & 0x01 else 'H'
+    offset = 16 + (512 if header[6] & 0x04 else 0)
+
+    print(entry(crc32(data[offset:]), rom_size(header[4], header[9] & 0xF, 0x4000), rom_size(header[5], header[9] >> 4, 0x2000),
+        (header[6] >> 4) | (header[7] & 0xF0) | ((header[8] & 0xF) << 8), header[8] >> 4, mirroring,
+        ram_size(header[10] & 0xF), ram_size(header[10] >> 4), ram_size(header[11] & 0xF), ram_size(header[11] >> 4), header[12]))
+
+def main():
+
+    if len(argv) < 2:
+        print('Usage: %s nes20db.xml | rom.nes ...' % argv[0], file=stderr)
+        return
+
+    for path in argv[1:]:
+        if path.lower().endswith('.xml'): from_xml(path)
+        else: from_rom(path)
+
+if __name__ == "__main__": main()
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+'''
+    Converts a binary instruction trace, written by running the emulator with --trace, into text. One line per instruction
+        in roughly the same layout as the nestest logs, so two traces (or a trace and a log from another emulator) can be
+        compared with diff. The record layout is described in include/trace.hh.
+
+    Usage: ./testing/trace2txt.py trace.bin [out.txt]
+'''
+
+from sys import argv, stdout # for command line arguments
+import struct
+
+# Opcode table matching the lookup table in 2A03.cc, including how it treats unofficial opcodes
+OPCODES = [
+    ("BRK","IMM"), ("ORA","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ORA","ZP0"), ("ASL","ZP0"), ("NOP","IMP"), ("PHP","IMP"), ("ORA","IMM"), ("ASL","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ORA","ABS"), ("ASL","ABS"), ("NOP","IMP"),
+    ("BPL","REL"), ("ORA","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ORA","ZPX"), ("ASL","ZPX"), ("NOP","IMP"), ("CLC","IMP"), ("ORA","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ORA","ABX"), ("ASL","ABX"), ("NOP","IMP"),
+    ("JSR","ABS"), ("AND","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("BIT","ZP0"), ("AND","ZP0"), ("ROL","ZP0"), ("NOP","IMP"), ("PLP","IMP"), ("AND","IMM"), ("ROL","IMP"), ("NOP","IMP"), ("BIT","ABS"), ("AND","ABS"), ("ROL","ABS"), ("NOP","IMP"),
+    ("BMI","REL"), ("AND","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("AND","ZPX"), ("ROL","ZPX"), ("NOP","IMP"), ("SEC","IMP"), ("AND","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("AND","ABX"), ("ROL","ABX"), ("NOP","IMP"),
+    ("RTI","IMP"), ("EOR","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("EOR","ZP0"), ("LSR","ZP0"), ("NOP","IMP"), ("PHA","IMP"), ("EOR","IMM"), ("LSR","IMP"), ("NOP","IMP"), ("JMP","ABS"), ("EOR","ABS"), ("LSR","ABS"), ("NOP","IMP"),
+    ("BVC","REL"), ("EOR","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("EOR","ZPX"), ("LSR","ZPX"), ("NOP","IMP"), ("CLI","IMP"), ("EOR","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("EOR","ABX"), ("LSR","ABX"), ("NOP","IMP"),
+    ("RTS","IMP"), ("ADC","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ADC","ZP0"), ("ROR","ZP0"), ("NOP","IMP"), ("PLA","IMP"), ("ADC","IMM"), ("ROR","IMP"), ("NOP","IMP"), ("JMP","IND"), ("ADC","ABS"), ("ROR","ABS"), ("NOP","IMP"),
+    ("BVS","REL"), ("ADC","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ADC","ZPX"), ("ROR","ZPX"), ("NOP","IMP"), ("SEI","IMP"), ("ADC","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("ADC","ABX"), ("ROR","ABX"), ("NOP","IMP"),
+    ("NOP","IMP"), ("STA","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("STY","ZP0"), ("STA","ZP0"), ("STX","ZP0"), ("NOP","IMP"), ("DEY","IMP"), ("NOP","IMP"), ("TXA","IMP"), ("NOP","IMP"), ("STY","ABS"), ("STA","ABS"), ("STX","ABS"), ("NOP","IMP"),
+    ("BCC","REL"), ("STA","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("STY","ZPX"), ("STA","ZPX"), ("STX","ZPY"), ("NOP","IMP"), ("TYA","IMP"), ("STA","ABY"), ("TXS","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("STA","ABX"), ("NOP","IMP"), ("NOP","IMP"),
+    ("LDY","IMM"), ("LDA","IZX"), ("LDX","IMM"), ("NOP","IMP"), ("LDY","ZP0"), ("LDA","ZP0"), ("LDX","ZP0"), ("NOP","IMP"), ("TAY","IMP"), ("LDA","IMM"), ("TAX","IMP"), ("NOP","IMP"), ("LDY","ABS"), ("LDA","ABS"), ("LDX","ABS"), ("NOP","IMP"),
+    ("BCS","REL"), ("LDA","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("LDY","ZPX"), ("LDA","ZPX"), ("LDX","ZPY"), ("NOP","IMP"), ("CLV","IMP"), ("LDA","ABY"), ("TSX","IMP"), ("NOP","IMP"), ("LDY","ABX"), ("LDA","ABX"), ("LDX","ABY"), ("NOP","IMP"),
+    ("CPY","IMM"), ("CMP","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("CPY","ZP0"), ("CMP","ZP0"), ("DEC","ZP0"), ("NOP","IMP"), ("INY","IMP"), ("CMP","IMM"), ("DEX","IMP"), ("NOP","IMP"), ("CPY","ABS"), ("CMP","ABS"), ("DEC","ABS"), ("NOP","IMP"),
+    ("BNE","REL"), ("CMP","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("CMP","ZPX"), ("DEC","ZPX"), ("NOP","IMP"), ("CLD","IMP"), ("CMP","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("CMP","ABX"), ("DEC","ABX"), ("NOP","IMP"),
+    ("CPX","IMM"), ("SBC","IZX"), ("NOP","IMP"), ("NOP","IMP"), ("CPX","ZP0"), ("SBC","ZP0"), ("INC","ZP0"), ("NOP","IMP"), ("INX","IMP"), ("SBC","IMM"), ("NOP","IMP"), ("SBC","IMP"), ("CPX","ABS"), ("SBC","ABS"), ("INC","ABS"), ("NOP","IMP"),
+    ("BEQ","REL"), ("SBC","IZY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("SBC","ZPX"), ("INC","ZPX"), ("NOP","IMP"), ("SED","IMP"), ("SBC","ABY"), ("NOP","IMP"), ("NOP","IMP"), ("NOP","IMP"), ("SBC","ABX"), ("INC","ABX"), ("NOP","IMP"),
+]
+
+# Instruction length in bytes per addressing mode
+LENGTH = { "IMP": 1, "IMM": 2, "ZP0": 2, "ZPX": 2, "ZPY": 2, "REL": 2, "IZX": 2, "IZY": 2, "ABS": 3, "ABX": 3, "ABY": 3, "IND": 3 }
+
+RECORD = struct.Struct("<QHhH5B3B2x")
+
+def operand(mode, pc, lo, hi):
+    word = lo | (hi << 8)
+    if mode == "IMP": return ""
+    if mode == "IMM": return "#$%02X" % lo
+    if mode == "ZP0": return "$%02X" % lo
+    if mode == "ZPX": return "$%02X,X" % lo
+    if mode == "ZPY": return "$%02X,Y" % lo
+    if mode == "REL": return "$%04X" % ((pc + 2 + (lo - 0x100 if lo & 0x80 else lo)) & 0xFFFF)
+    if mode == "IZX": return "($%02X,X)" % lo
+    if mode == "IZY": return "($%02X),Y" % lo
+    if mode == "ABS": return "$%04X" % word
+    if mode == "ABX": return "$%04X,X" % word
+    if mode == "ABY": return "$%04X,Y" % word
+    if mode == "IND": return "($%04X)" % word
+
+with open(argv[1], "rb") as trace:
+
+    magic = trace.read(8)
+    version, record_size = struct.unpack("<II", trace.read(8))
+    if magic != b"NESTRACE" or record_size < RECORD.size:
+        raise SystemExit("Not a trace file: " + argv[1])
+
+    outfile = open(argv[2], "w") if len(argv) > 2 else stdout
+
+    while True:
+        record = trace.read(record_size)
+        if len(record) < record_size: break
+
+        cycle, pc, scanline, dot, a, x, y, p, s, b0, b1, b2 = RECORD.unpack(record[:RECORD.size])
+        name, mode = OPCODES[b0]
+        raw = " ".join("%02X" % b for b in (b0, b1, b2)[:LENGTH[mode]])
+
+        outfile.write("%04X  %-8s  %-4s%-10s  A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%d\n" %
+            (pc, raw, name, operand(mode, pc, b1, b2), a, x, y, p, s, scanline, dot, cycle))
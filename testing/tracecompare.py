@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+
+'''
+    Runs a rom headless with two builds of the emulator, tracing every instruction, and compares the traces record by
+        record. Each record holds the registers (including the full status register) before the instruction along with
+        the cycle and PPU position it started on, so any change to the CPU core that isn't meant to change behaviour
+        should produce identical traces. Reports the first instruction the two builds disagree on.
+
+    Traces come from the same code the CPU runs untraced, the block cache and whichever dispatch engine is in use. The
+        second build is traced once with each engine (--dispatch), all of them compared against the first build.
+
+    Usage: ./testing/tracecompare.py ./nes_before ./nes_after path/to/rom.nes [frames]
+'''
+
+from sys import argv, exit # for command line arguments
+import os
+import struct
+import subprocess
+import tempfile
+
+RECORD = struct.Struct("<QHhH5B3B2x")
+FIELDS = ("cycle", "pc", "scanline", "dot", "a", "x", "y", "p", "s")
+ENGINES = ("call", "switch", "goto")
+
+def trace(emulator, rom, frames, path, options=[]):
+    subprocess.run([emulator, rom, "--headless", "--frames", frames, "--trace", path] + options,
+                   stdout=subprocess.DEVNULL, check=True)
+
+def records(path):
+    trace = open(path, "rb")
+    magic = trace.read(8)
+    version, record_size = struct.unpack("<II", trace.read(8))
+    if magic != b"NESTRACE" or record_size < RECORD.size:
+        raise SystemExit("Not a trace file: " + path)
+    return trace, record_size
+
+def describe(record):
+    return " ".join("%s:%X" % (name, value) for name, value in zip(FIELDS, record))
+
+# Returns the number of identical records, or None after reporting the first difference
+def compare(before, size_before, after, size_after):
+
+    index = 0
+    while True:
+        a, b = before.read(size_before), after.read(size_after)
+        if len(a) < RECORD.size or len(b) < RECORD.size:
+            break
+
+        # Only the fields both builds know about are compared
+        ra, rb = RECORD.unpack_from(a), RECORD.unpack_from(b)
+        if ra != rb:
+            print("MISMATCH at instruction %d" % index)
+            print("  before: " + describe(ra))
+            print("  after:  " + describe(rb))
+            return None
+        index += 1
+
+    if len(a) >= RECORD.size or len(b) >= RECORD.size:
+        print("MISMATCH, one trace ends after %d instructions" % index)
+        return None
+    return index
+
+frames = argv[4] if len(argv) > 4 else "600"
+failed = False
+
+with tempfile.TemporaryDirectory() as directory:
+
+    before_path, after_path = os.path.join(directory, "before.bin"), os.path.join(directory, "after.bin")
+    trace(argv[1], argv[3], frames, before_path)
+
+    for engine in ENGINES:
+        trace(argv[2], argv[3], frames, after_path, ["--dispatch", engine])
+        (before, size_before), (after, size_after) = records(before_path), records(after_path)
+
+        print("%-8s" % engine, end=" ")
+        identical = compare(before, size_before, after, size_after)
+        if identical is None: failed = True
+        else: print("%d instructions identical" % identical)
+
+        before.close()
+        after.close()
+
+exit(1 if failed else 0)